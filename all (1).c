@@ -1,25 +1,75 @@
+// Build: gcc -O2 -pthread "all (1).c" -o therapy -lm
+// Add -DNO_METRICS to compile the instrumentation out entirely.
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
-#define MAX_PATIENTS 100
-#define MAX_THERAPISTS 50
-#define MAX_SUPERVISORS 20
 #define MAX_GOALS 10
-#define MAX_SESSIONS 50
 #define FILENAME "therapy_data.dat"
+#define WAL_FILENAME "therapy_data.wal"
+#define SNAPSHOT_MAGIC 0x53544c53 /* "SLTS" */
+#define SNAPSHOT_VERSION 6
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_ALIGN 4096
+#define DATA_MAGIC 0x45544c53 /* "SLTE", stream format with LSN */
+#define DATA_MAGIC_NO_LSN 0x44544c53 /* "SLTD", written before the WAL existed */
+#define WAL_MAGIC 0x57544c53 /* "SLTW" */
+#define WAL_GROUP_COMMIT_RECORDS 64
+#define WAL_GROUP_COMMIT_MS 50
+#define BATCH_GROUP_COMMIT_RECORDS 16384
+#define BATCH_GROUP_COMMIT_MS 200
+#define BATCH_BUFFER_BYTES (1 << 20)
+#define BATCH_MAX_FIELDS 16
+#define REPORT_BUFFER_BYTES (64 * 1024)
+#define EXPORT_MAX_THREADS 64
+#define EXPORT_ARCHIVE_FLUSH_BYTES (256 * 1024)
+#define WAL_CHECKPOINT_BYTES (8L * 1024 * 1024)
+#define NO_SESSION -1
+#define EVALUATION_MIN_SESSIONS 10
+
+// Free text lives in an append-only heap of length-prefixed strings and is
+// referenced by offset. Ref 0 is always the empty string.
+typedef uint32_t StrRef;
+
+// Dates are day numbers counted from 0000-03-01, so they compare and
+// subtract as integers and 0 is free to mean "no date".
+typedef int32_t Date;
+#define NO_DATE 0
+
+typedef struct {
+    char text[11];
+} DateText;
 
 typedef struct {
     int id;
     char name[100];
-    char diagnosis[200];
+    StrRef diagnosis;
     int age;
     char gender;
     char contact[15];
-    char admission_date[11]; 
+    Date admission_date;
 } Patient;
 
 typedef struct {
@@ -36,57 +86,652 @@ typedef struct {
     char email[50];
 } Supervisor;
 
+// Lifecycle states. Zero is left unused so that a zeroed CaseQuery means
+// "any status".
+typedef enum {
+    CASE_ACTIVE = 1,
+    CASE_COMPLETED,
+    CASE_DISCONTINUED,
+    CASE_DISCHARGED,
+    CASE_CLOSED,  // closed for a reason older data files did not record
+    CASE_STATUS_COUNT
+} CaseStatus;
+
+typedef enum {
+    GOAL_NOT_STARTED = 1,
+    GOAL_IN_PROGRESS,
+    GOAL_COMPLETED,
+    GOAL_STATUS_COUNT
+} GoalStatus;
+
+static const char *case_status_names[CASE_STATUS_COUNT] = {
+    "", "Active", "Completed", "Discontinued", "Discharged", "Closed"
+};
+static const char *goal_status_names[GOAL_STATUS_COUNT] = {
+    "", "Not Started", "In Progress", "Completed"
+};
+
 typedef struct {
     int id;
-    char description[200];
+    StrRef description;
     int target_sessions;
     int achieved;
-    char status[20];
+    uint8_t status;
 } TherapyGoal;
 
+// Sessions of all cases are appended to one session log; each case keeps
+// the head and tail of its own chain through next_in_case. Linking a
+// session into its chain is lock-free (see session_link), so a chain can
+// be walked while it grows and always shows a complete prefix. Appends
+// need the store lock only for reading (see append_session).
 typedef struct {
     int session_id;
+    int case_id;
     int patient_id;
     int therapist_id;
-    char date[11];
-    char activities[500];
-    char observations[500];
-    char supervisor_feedback[500];
+    Date date;
+    StrRef activities;
+    StrRef observations;
+    StrRef supervisor_feedback;
     bool supervisor_reviewed;
+    int next_in_case;
 } TherapySession;
 
+// Cases are split in two stores indexed by the same slot: the compact
+// header that dashboards and filters scan, and the goals, which only plan,
+// session and report screens read.
 typedef struct {
     int id;
     int patient_id;
     int therapist_id;
     int supervisor_id;
-    TherapyGoal goals[MAX_GOALS];
-    int goal_count;
-    TherapySession sessions[MAX_SESSIONS];
     int session_count;
-    bool is_active;
+    int goal_count;
+    int first_session;
+    int last_session;
     float clinical_rating;
-    char start_date[11];
-    char end_date[11];
-    char status[20];
+    Date start_date;
+    Date end_date;
+    bool is_active;
+    uint8_t status;
 } TherapyCase;
 
-Patient patients[MAX_PATIENTS];
-Therapist therapists[MAX_THERAPISTS];
-Supervisor supervisors[MAX_SUPERVISORS];
-TherapyCase cases[MAX_PATIENTS];
+typedef struct {
+    TherapyGoal goals[MAX_GOALS];
+} CaseGoals;
+
+// Chunked arena: records live in fixed-size chunks that are never moved,
+// so pointers handed out by pool_at stay valid as the store grows.
+#define POOL_CHUNK_BYTES (256 * 1024)
+#define POOL_MIN_CHUNK_SHIFT 4
+
+typedef struct {
+    size_t elem_size;
+    int chunk_shift;
+    char **chunks;
+    int chunk_count;
+    int chunk_capacity;
+} Pool;
+
+Pool patient_pool = { sizeof(Patient) };
+Pool therapist_pool = { sizeof(Therapist) };
+Pool supervisor_pool = { sizeof(Supervisor) };
+Pool case_pool = { sizeof(TherapyCase) };
+Pool case_goal_pool = { sizeof(CaseGoals) };
+Pool session_pool = { sizeof(TherapySession) };
+
+// A read view is a point-in-time, read-only picture of the case, goal and
+// session stores for long-running readers such as exports. Opening one
+// only records the chunk directories and counts. Writers copy a chunk (and
+// its directory) before changing a record a live view can see, so a view
+// never observes a half-applied mutation and never blocks a writer.
+// Replaced chunks and directories are retired with the current epoch and
+// freed once every view opened at or before that epoch has closed.
+//
+// Only views are tracked. Session appends copy records while readers that
+// hold store_lock without a view may still be using the originals, so
+// retired memory is only freed at a point where no such reader can be
+// left (see read_view_close). pool_reserve never frees a directory it
+// outgrows.
+enum { VIEW_CASES, VIEW_GOALS, VIEW_SESSIONS, VIEW_POOLS };
+
+typedef struct ReadView {
+    uint64_t epoch;
+    int case_count;
+    int patient_count;
+    int session_count;
+    char **chunks[VIEW_POOLS];
+    int chunk_count[VIEW_POOLS];
+    struct ReadView *older;
+    struct ReadView *newer;
+} ReadView;
+
+typedef struct Retired {
+    void *ptr;
+    uint64_t epoch;
+    struct Retired *next;
+} Retired;
+
+pthread_mutex_t view_lock = PTHREAD_MUTEX_INITIALIZER;
+ReadView *oldest_view = NULL;
+ReadView *newest_view = NULL;
+_Atomic int live_views = 0;
+uint64_t view_epoch = 0;
+Retired *retired_list = NULL;
+static __thread ReadView *current_view = NULL;
+
+// Full chunks of a loaded data file point into its mapping and are never freed.
+char *data_map = NULL;
+size_t data_map_size = 0;
+
+#define STR_CHUNK_SHIFT 16
+#define STR_CHUNK_BYTES (1 << STR_CHUNK_SHIFT)
+// Entries are [length lo][length hi][bytes][NUL]. The top bit of the
+// length marks bytes encoded against the text dictionary.
+#define STR_PACKED 0x8000
+#define STR_MAX_LEN (STR_PACKED - 1)
+
+typedef struct {
+    char **chunks;
+    int chunk_count;
+    int chunk_capacity;
+    uint32_t used;
+} StringHeap;
+
+StringHeap string_heap;
+
+// Clinical free text repeats a small vocabulary, so it is stored as a
+// sequence of tokens: a word id (one byte for the most frequent 128
+// words, two bytes for the rest) or a run of literal bytes. A single
+// space between two dictionary words is implied. The dictionary is
+// trained from the data (see text_store_train); words first seen later
+// are stored as literals until a checkpoint finds enough of them to
+// train a new version and re-encode the heap.
+#define TEXT_DICT_SHORT 128
+#define TEXT_DICT_MAX (TEXT_DICT_SHORT + (1 << 14))
+#define TEXT_WORD_MAX 32
+#define TEXT_LITERAL_MAX 64
+#define TEXT_RETRAIN_MIN_BYTES (64 * 1024)
+
+typedef struct {
+    char *chars;
+    uint32_t *offsets;  // count + 1 entries; word i is chars[offsets[i]..offsets[i + 1])
+    uint32_t count;
+    uint32_t version;
+    uint32_t *table;    // open addressing on text_hash, holding word id + 1
+    uint32_t table_capacity;
+} TextDictionary;
+
+TextDictionary text_dict;
+
+// Bytes stored uncompressed (plain entries and literal runs), and the
+// heap size and that count as of the last training.
+size_t text_literal_bytes = 0;
+size_t text_trained_heap_bytes = 0, text_trained_literal_bytes = 0;
+
+// Open-addressing hash index from a positive entity ID to its pool slot.
+typedef struct {
+    int *keys;
+    int *slots;
+    int capacity;
+    int size;
+    bool mapped;
+} IdIndex;
+
+IdIndex patient_index;
+IdIndex therapist_index;
+IdIndex supervisor_index;
+IdIndex case_index;
+
+// Secondary indexes. Case slots are only ever appended, so every posting
+// list stays sorted by slot and lists can be intersected by merging.
+typedef struct {
+    int *items;
+    int count;
+    int capacity;
+} CaseList;
+
+typedef struct {
+    IdIndex keys;
+    CaseList *lists;
+    int list_count;
+    int list_capacity;
+} PostingIndex;
+
+typedef struct {
+    uint64_t *words;
+    int word_capacity;
+    int count;
+} StatusBitmap;
+
+typedef struct {
+    int patient_id;
+    int therapist_id;
+    int supervisor_id;
+    int status;
+    int min_sessions;
+} CaseQuery;
+
+// Every change to the case store is described by a Mutation. The same
+// record is applied to memory, appended to the write-ahead log and
+// replayed from it after a restart.
+typedef enum {
+    MUT_NEW_CASE = 1,
+    MUT_ADD_GOAL,
+    MUT_MODIFY_GOAL,
+    MUT_SESSION,
+    MUT_EVALUATE,
+    MUT_CLOSE
+} MutationType;
+
+typedef struct {
+    int type;
+    int case_id;
+    int therapist_id;
+    int supervisor_id;
+    int age;
+    int goal_num;
+    int target_sessions;
+    float rating;
+    char gender;
+    Date date;
+    const char *name;
+    const char *diagnosis;
+    const char *contact;
+    const char *description;
+    const char *activities;
+    const char *observations;
+    const char *feedback;
+    int status;
+} Mutation;
+
+// Log records are [payload length][crc32][lsn][type][payload]; strings in
+// the payload are length-prefixed and NUL-terminated.
+typedef struct {
+    FILE *file;
+    uint64_t next_lsn;
+    uint64_t checkpoint_lsn;
+    int pending;
+    int group_records;
+    int group_ms;
+    long size;
+    struct timespec last_sync;
+} WriteAheadLog;
+
+WriteAheadLog wal;
+
+// Instrumentation: per-operation latency histograms and global counters,
+// updated with relaxed atomics so server threads can share them.
+// Histograms are log-linear in the style of HdrHistogram: values below
+// 8 ns are exact, above that each power of two is split into 8 buckets,
+// which bounds the recorded error at 12.5%.
+enum {
+    OP_LOAD_DATA, OP_SAVE_DATA, OP_WAL_RECOVER, OP_WAL_SYNC, OP_CHECKPOINT, OP_APPLY_MUTATION,
+    OP_QUERY_CASES, OP_TEXT_SEARCH, OP_SESSIONS_IN_RANGE, OP_PROGRESS_REPORT, OP_EXPORT_REPORTS,
+    OP_ANALYTICS, OP_SEARCH_MENU, OP_THERAPIST_MENU, OP_SUPERVISOR_MENU, OP_SERVER_READ,
+    OP_SERVER_WRITE, OP_COUNT
+};
+
+enum {
+    MC_DATA_BYTES_LOADED, MC_DATA_BYTES_SAVED, MC_WAL_BYTES_WRITTEN, MC_REPORT_BYTES,
+    MC_ID_INDEX_HITS, MC_ID_INDEX_MISSES, MC_POSTING_HITS, MC_POSTING_MISSES,
+    MC_TEXT_TERM_HITS, MC_TEXT_TERM_MISSES, MC_COUNT
+};
+
+#define METRIC_SUB_BITS 3
+#define METRIC_BUCKETS (64 << METRIC_SUB_BITS)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRIC_BUCKETS];
+} OpMetrics;
+
+typedef struct {
+    int op;
+    uint64_t start;
+} MetricScope;
+
+bool metrics_at_exit_json = false;
+
+#ifndef NO_METRICS
+OpMetrics op_metrics[OP_COUNT];
+_Atomic uint64_t metric_counters[MC_COUNT];
+
+#define METRIC_NOW() metrics_now()
+#define METRIC_RECORD(op, start) metrics_record((op), (start))
+// Times the rest of the enclosing block, whichever way it is left.
+#define METRIC_SCOPE(op) MetricScope metric_scope __attribute__((cleanup(metrics_scope_end))) = { (op), metrics_now() }
+#define METRIC_ADD(counter, n) atomic_fetch_add_explicit(&metric_counters[counter], (uint64_t)(n), memory_order_relaxed)
+#else
+#define METRIC_NOW() 0
+#define METRIC_RECORD(op, start) ((void)(start))
+#define METRIC_SCOPE(op) ((void)0)
+#define METRIC_ADD(counter, n) ((void)0)
+#endif
+
+// Reports are formatted into one reusable buffer that is written out to
+// every sink whenever it fills up. With no sinks the buffer simply grows
+// and holds the whole text.
+#define REPORT_MAX_SINKS 2
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    FILE *sinks[REPORT_MAX_SINKS];
+    int sink_count;
+} ReportWriter;
+
+typedef struct {
+    CaseQuery query;
+    Date from;
+    Date to;
+} ExportFilter;
+
+// Therapists are grouped into specialty buckets by keyword, and each bucket
+// keeps a min-heap of therapist slots ordered by current caseload, so the
+// least loaded matching therapist is always at the top.
+#define DEFAULT_CASELOAD_LIMIT 30
+#define SPECIALTY_BUCKETS 5
+#define ADMISSION_QUEUE_MAX 4096
+
+typedef struct {
+    const char *name;
+    const char *keywords[12];
+} SpecialtyBucket;
+
+typedef struct {
+    int *slots;
+    int count;
+    int capacity;
+} TherapistHeap;
+
+// Full-text index over the clinical text fields. Every indexed string is a
+// document; documents are numbered in the order they are added, so
+// postings are appended in document order and stay sorted without any
+// extra work.
+// A document's owner records which field it came from, and a document is
+// stale once that field has been rewritten with a different string.
+#define TEXT_MAX_TERM 32
+#define TEXT_MAX_RESULTS 20
+#define TEXT_OWNER_SHIFT 28
+#define TEXT_OWNER(kind, value) (((kind) << TEXT_OWNER_SHIFT) | (value))
+
+enum {
+    TEXT_DIAGNOSIS = 1,
+    TEXT_GOAL,
+    TEXT_ACTIVITIES,
+    TEXT_OBSERVATIONS,
+    TEXT_FEEDBACK
+};
+
+typedef struct {
+    StrRef ref;
+    int owner;
+    uint32_t length;
+} TextDoc;
+
+// Ref of a stale document once the heap has been re-encoded; it matches
+// no field.
+#define TEXT_DOC_STALE UINT32_MAX
+
+typedef struct {
+    uint32_t doc;
+    uint32_t pos;
+} TextPosting;
+
+typedef struct {
+    uint32_t text;
+    uint32_t doc_count;
+    TextPosting *postings;
+    uint32_t count;
+    uint32_t capacity;
+} TextTerm;
+
+typedef struct {
+    uint32_t doc;
+    float score;
+} TextHit;
+
+typedef struct {
+    TextHit *items;
+    int count;
+    int capacity;
+} TextHits;
+
+// Sessions ordered by date, kept as one large sorted run plus a small
+// sorted run of late entries (sessions recorded out of date order) that
+// is merged in once it fills up.
+#define DATE_INDEX_RUN_MAX 4096
+
+typedef struct {
+    Date date;
+    int case_slot;
+    int session;
+} SessionDateEntry;
+
+typedef struct {
+    SessionDateEntry *items;
+    int count;
+    int capacity;
+} SessionDateRun;
+
+typedef struct {
+    int therapist_id;
+    int supervisor_id;
+    bool unreviewed_only;
+    int count;
+} SessionFilter;
+
+// Cases waiting for supervisor evaluation, one FIFO queue per supervisor.
+// The queues are doubly linked through a per-case link array, so adding,
+// removing and finding the next case are all O(1).
+typedef struct {
+    int head;
+    int tail;
+    int count;
+} ReviewQueue;
+
+typedef struct {
+    int prev;
+    int next;
+    bool queued;
+} ReviewLink;
+
+// Server mode: clients send one request per line over a Unix domain
+// socket. A single epoll loop owns every connection and only moves
+// bytes. Reads go to a pool of reader threads, which answer them under
+// the store's read lock; mutations are queued to a writer thread, which
+// applies them in arrival order and syncs the WAL once per batch. Both
+// hand their results back to the loop.
+#define SERVER_SOCKET "therapy.sock"
+#define SERVER_MAX_LINE (64 * 1024)
+#define SERVER_MAX_EVENTS 256
+#define SERVER_MIN_READERS 4
+#define SERVER_MAX_READERS 16
+
+struct Connection;
+
+typedef struct WriteRequest {
+    Mutation m;
+    int result;
+    uint64_t queued_ns;
+    struct Connection *owner;
+    struct WriteRequest *next;
+} WriteRequest;
+
+typedef struct ReadRequest {
+    char *command;
+    char *arg;
+    const char *error;
+    ReportWriter reply;
+    struct Connection *owner;
+    struct ReadRequest *next;
+} ReadRequest;
+
+// Synthetic clinics for --generate and --bench. Zero staff counts are
+// derived from the number of cases.
+typedef struct {
+    int cases;
+    int therapists;
+    int supervisors;
+    int goals_per_case;
+    int sessions_per_case;
+    int note_words;
+    uint64_t seed;
+} ClinicConfig;
+
+typedef void (*PhaseReport)(const char *phase, double ms, long ops, void *ctx);
+
+// Column projections of the hot numeric case and session fields, built
+// from the pools for one analytics run. Group keys are stored as dense
+// codes (therapist slot, month number, diagnosis code) so aggregates are
+// plain array updates.
+#define ANALYTICS_TOP_DIAGNOSES 15
+#define ANALYTICS_MAX_MONTHS 600
+
+typedef struct {
+    int count;
+    int32_t *therapist;
+    int32_t *supervisor;
+    int32_t *diagnosis;
+    int32_t *sessions;
+    int32_t *goals;
+    int32_t *goals_completed;
+    int32_t *achieved;
+    int32_t *target;
+    float *rating;
+    uint8_t *active;
+    uint8_t *selected;
+    
+    int session_count;
+    int32_t *session_case;
+    int32_t *session_month;
+    
+    char **diagnosis_names;
+    int diagnosis_count;
+} CaseColumns;
+bool data_needs_migration = false;
+
+bool secondary_indexes_ready = false;
+PostingIndex cases_by_patient;
+PostingIndex cases_by_therapist;
+PostingIndex cases_by_supervisor;
+StatusBitmap status_bitmaps[CASE_STATUS_COUNT];
+
+bool allocation_ready = false;
+TherapistHeap therapist_heaps[SPECIALTY_BUCKETS];
+int *therapist_heap_pos = NULL;
+unsigned char *therapist_bucket = NULL;
+int caseload_limit = DEFAULT_CASELOAD_LIMIT;
+
+bool date_index_ready = false;
+SessionDateRun sessions_by_date;
+SessionDateRun sessions_by_date_late;
+
+bool review_queues_ready = false;
+IdIndex review_queue_keys;
+ReviewQueue *review_queues = NULL;
+int review_queue_count = 0, review_queue_capacity = 0;
+ReviewLink *review_links = NULL;
+int review_link_capacity = 0;
+
+pthread_rwlock_t store_lock = PTHREAD_RWLOCK_INITIALIZER;
+// Session appends run under store_lock held for reading (see
+// append_session), so what they share has locks of its own. Their
+// rwlocks prefer writers, so a steady stream of appends cannot keep a
+// view from opening, nor searches keep an append from indexing.
+#define GOAL_LOCK_STRIPES 64
+pthread_rwlock_t append_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+pthread_mutex_t append_copy_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t string_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t text_index_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+pthread_rwlock_t date_index_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+pthread_mutex_t review_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t goal_locks[GOAL_LOCK_STRIPES] = { [0 ... GOAL_LOCK_STRIPES - 1] = PTHREAD_MUTEX_INITIALIZER };
+pthread_mutex_t write_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t write_queue_ready = PTHREAD_COND_INITIALIZER;
+WriteRequest *write_queue_head = NULL, *write_queue_tail = NULL;
+pthread_mutex_t write_done_lock = PTHREAD_MUTEX_INITIALIZER;
+WriteRequest *write_done_head = NULL;
+ReadRequest *read_done_head = NULL;  // also under write_done_lock
+pthread_mutex_t read_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t read_queue_ready = PTHREAD_COND_INITIALIZER;
+ReadRequest *read_queue_head = NULL, *read_queue_tail = NULL;
+int server_wake_fd = -1;
+volatile sig_atomic_t server_stopping = 0;
+
+bool text_index_ready = false;
+TextDoc *text_docs = NULL;
+uint32_t text_doc_count = 0, text_doc_capacity = 0;
+uint64_t text_total_length = 0;
+TextTerm *text_terms = NULL;
+uint32_t text_term_count = 0, text_term_capacity = 0;
+uint32_t *text_term_table = NULL;
+uint32_t text_table_capacity = 0;
+char *text_term_chars = NULL;
+size_t text_term_chars_used = 0, text_term_chars_capacity = 0;
 
 int patient_count = 0;
 int therapist_count = 0;
 int supervisor_count = 0;
 int case_count = 0;
+int session_log_count = 0;
 
+void pool_reserve(Pool *pool, int count);
+size_t pool_read(Pool *pool, FILE *file, int count);
+size_t pool_write(Pool *pool, FILE *file, int count);
+StrRef str_put(const char *text);
+const char *str_get(StrRef ref, char *buf, size_t size);
+StrRef text_owner_ref(int owner);
+void id_index_put(IdIndex *index, int id, int slot);
+int id_index_get(IdIndex *index, int id);
+void rebuild_indexes();
+Patient *find_patient(int id);
+Therapist *find_therapist(int id);
+Supervisor *find_supervisor(int id);
+int find_case(int id);
+CaseList *posting_get(PostingIndex *index, int key);
+void status_set(int status, int slot, bool on);
+int status_count(int status, const CaseList *within);
+void index_case(int slot);
+int query_cases(const CaseQuery *q, void (*emit)(int slot, void *ctx), void *ctx);
+void print_case_row(int slot, void *ctx);
+uint32_t text_hash(const char *term, size_t len);
+void text_index_add(StrRef ref, int owner);
+int text_search(const char *query, void (*emit)(uint32_t doc, float score, void *ctx), void *ctx);
+void print_text_hit(uint32_t doc, float score, void *ctx);
+void date_index_add(Date date, int case_slot, int session);
+int sessions_in_range(Date from, Date to, void (*emit)(const SessionDateEntry *e, void *ctx), void *ctx);
+void print_session_row(const SessionDateEntry *e, void *ctx);
+void print_sessions_in_range(SessionFilter *filter, Date from, Date to);
+void review_update(int slot);
+int review_pending(int supervisor_id);
+int review_next(int supervisor_id);
+int review_list(int supervisor_id, int *slots, int max);
+int session_new(TherapyCase *c);
+void session_link(TherapyCase *c, int session_index);
+static inline int session_total(const TherapyCase *c);
 void load_data();
 void save_data();
+int apply_mutation(const Mutation *m);
+int commit_mutation(const Mutation *m);
+int append_session(const Mutation *m);
+void wal_open();
+void wal_recover();
+void wal_sync();
+void wal_checkpoint();
 void allocate_case(bool auto_allocate);
 void create_therapy_plan(int case_index);
 void record_session(int case_index);
 void generate_progress_report(int case_index, bool export_to_file);
+void report_printf(ReportWriter *w, const char *fmt, ...);
+void report_flush(ReportWriter *w);
+bool write_progress_report(ReportWriter *w, int case_index);
+int export_reports(const ExportFilter *filter, const char *archive_path);
+void print_analytics(int supervisor_id);
 void evaluate_case(int case_index);
 void view_case_details(int case_index);
 void list_all_cases();
@@ -94,992 +739,6728 @@ void search_cases();
 void close_case(int case_index);
 void therapist_dashboard(int therapist_id);
 void supervisor_dashboard(int supervisor_id);
-int find_available_therapist();
-bool validate_date(const char *date);
+int find_available_therapist(const char *diagnosis);
+int allocate_admissions(Mutation *queue, int n);
+void therapist_load_changed(int slot);
+bool parse_date(const char *text, Date *date);
+bool parse_case_status(const char *text, int *status);
+bool parse_status_filter(const char *text, int *status);
+DateText date_text(Date date);
+Date date_today();
 void print_menu_header(const char *title);
 void clear_input_buffer();
 void to_lower_case(char *str);
+int run_batch(const char *path);
+const char *parse_batch_record(char **f, int n, Mutation *m, Date today);
+int split_csv(char *line, char **fields, int max_fields);
+int run_server(const char *socket_path);
+int run_loadgen(const char *socket_path, int idle, long requests, int clients, int write_percent, int cases);
+int run_session_stress(int writers, long appends, int cases);
+void prepare_shared_indexes();
+void metrics_write(ReportWriter *w, bool json);
+void metrics_dump_at_exit();
+void generate_clinic(ClinicConfig *cfg, PhaseReport report, void *ctx);
+int run_generate(ClinicConfig *cfg);
+int run_bench(ClinicConfig *cfg, const char *sizes, const char *json_path);
 
-void clear_input_buffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+#ifndef NO_METRICS
+static inline uint64_t metrics_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
 }
 
-void to_lower_case(char *str) {
-    for (int i = 0; str[i]; i++) {
-        str[i] = tolower(str[i]);
-    }
+static inline int metrics_bucket(uint64_t ns) {
+    if (ns < (1u << METRIC_SUB_BITS)) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    return ((msb - METRIC_SUB_BITS + 1) << METRIC_SUB_BITS) +
+           (int)((ns >> (msb - METRIC_SUB_BITS)) & ((1u << METRIC_SUB_BITS) - 1));
+}
+
+void metrics_record(int op, uint64_t start) {
+    uint64_t ns = metrics_now() - start;
+    OpMetrics *m = &op_metrics[op];
+    atomic_fetch_add_explicit(&m->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->buckets[metrics_bucket(ns)], 1, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&m->max_ns, &max, ns, memory_order_relaxed,
+                                                              memory_order_relaxed));
+}
+
+static inline void metrics_scope_end(MetricScope *scope) {
+    metrics_record(scope->op, scope->start);
 }
+#endif
 
-bool validate_date(const char *date) {
-    if (strlen(date) != 10) return false;
-    if (date[4] != '-' || date[7] != '-') return false;
+// Safe to call from concurrent appenders: the common case only reads
+// chunk_count, and growth is serialized. A grown chunk directory is
+// published before the old one is dropped. The old one is never freed
+// (its size is below the new one's), so a reader still holding it stays
+// valid. This is separate from view retirement: directories replaced by
+// pool_prepare_write are freed once no view can see them (see ReadView).
+void pool_reserve(Pool *pool, int count) {
+    static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+    int shift = __atomic_load_n(&pool->chunk_shift, __ATOMIC_ACQUIRE);
+    if (shift != 0 && ((count + (1 << shift) - 1) >> shift) <= __atomic_load_n(&pool->chunk_count, __ATOMIC_ACQUIRE)) {
+        return;
+    }
     
-    for (int i = 0; i < 10; i++) {
-        if (i == 4 || i == 7) continue;
-        if (!isdigit(date[i])) return false;
+    pthread_mutex_lock(&grow_lock);
+    if (pool->chunk_shift == 0) {
+        shift = POOL_MIN_CHUNK_SHIFT;
+        while (((size_t)2 << shift) * pool->elem_size <= POOL_CHUNK_BYTES) shift++;
+        __atomic_store_n(&pool->chunk_shift, shift, __ATOMIC_RELEASE);
     }
     
-    return true;
+    int needed = (count + (1 << pool->chunk_shift) - 1) >> pool->chunk_shift;
+    if (needed > pool->chunk_capacity) {
+        int capacity = pool->chunk_capacity ? pool->chunk_capacity * 2 : 16;
+        while (capacity < needed) capacity *= 2;
+        char **chunks = malloc(capacity * sizeof(char *));
+        if (chunks == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        if (pool->chunk_count > 0) memcpy(chunks, pool->chunks, pool->chunk_count * sizeof(char *));
+        __atomic_store_n(&pool->chunks, chunks, __ATOMIC_RELEASE);
+        pool->chunk_capacity = capacity;
+    }
+    
+    while (pool->chunk_count < needed) {
+        char *chunk = calloc((size_t)1 << pool->chunk_shift, pool->elem_size);
+        if (chunk == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        pool->chunks[pool->chunk_count] = chunk;
+        __atomic_store_n(&pool->chunk_count, pool->chunk_count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&grow_lock);
 }
 
-void print_menu_header(const char *title) {
-    printf("\n================================\n");
-    printf("%s\n", title);
-    printf("================================\n");
+static inline void *pool_at(Pool *pool, int index) {
+    char **chunks = __atomic_load_n(&pool->chunks, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&chunks[index >> pool->chunk_shift], __ATOMIC_ACQUIRE) +
+           (size_t)(index & ((1 << pool->chunk_shift) - 1)) * pool->elem_size;
 }
 
-int main() {
-    load_data();
-    if (therapist_count == 0) {
-        therapist_count = 3;
-        strcpy(therapists[0].name, "John Smith"); 
-        therapists[0].id = 1;
-        strcpy(therapists[0].specialization, "Child Speech Disorders");
-        strcpy(therapists[0].email, "john.smith@therapy.com");
-        
-        strcpy(therapists[1].name, "Emily Davis"); 
-        therapists[1].id = 2;
-        strcpy(therapists[1].specialization, "Aphasia Rehabilitation");
-        strcpy(therapists[1].email, "emily.davis@therapy.com");
-        
-        strcpy(therapists[2].name, "Michael Johnson"); 
-        therapists[2].id = 3;
-        strcpy(therapists[2].specialization, "Voice Disorders");
-        strcpy(therapists[2].email, "michael.johnson@therapy.com");
+size_t pool_read(Pool *pool, FILE *file, int count) {
+    pool_reserve(pool, count);
+    size_t total = 0;
+    int per_chunk = 1 << pool->chunk_shift;
+    for (int i = 0; i < count; i += per_chunk) {
+        int n = (count - i < per_chunk) ? count - i : per_chunk;
+        size_t got = fread(pool_at(pool, i), pool->elem_size, n, file);
+        total += got;
+        if (got != (size_t)n) break;
+    }
+    return total;
+}
+
+size_t pool_write(Pool *pool, FILE *file, int count) {
+    size_t total = 0;
+    int per_chunk = 1 << pool->chunk_shift;
+    for (int i = 0; i < count; i += per_chunk) {
+        int n = (count - i < per_chunk) ? count - i : per_chunk;
+        total += fwrite(pool_at(pool, i), pool->elem_size, n, file);
+    }
+    return total;
+}
+
+// Record address as seen by the calling thread: through its read view if
+// it has entered one, otherwise the live store.
+static inline void *view_at(Pool *pool, int which, int index) {
+    const ReadView *v = current_view;
+    if (v == NULL) return pool_at(pool, index);
+    return v->chunks[which][index >> pool->chunk_shift] +
+           (size_t)(index & ((1 << pool->chunk_shift) - 1)) * pool->elem_size;
+}
+
+static void view_retire(void *ptr) {
+    if ((char *)ptr >= data_map && (char *)ptr < data_map + data_map_size) return;
+    Retired *r = malloc(sizeof(Retired));
+    if (r == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    r->ptr = ptr;
+    r->epoch = view_epoch;
+    r->next = retired_list;
+    retired_list = r;
+}
+
+// Frees what no live view can reach any more. Called with view_lock held.
+static void view_reclaim() {
+    uint64_t oldest = oldest_view != NULL ? oldest_view->epoch : UINT64_MAX;
+    for (Retired **link = &retired_list; *link != NULL;) {
+        Retired *r = *link;
+        if (r->epoch < oldest) {
+            *link = r->next;
+            free(r->ptr);
+            free(r);
+        } else {
+            link = &r->next;
+        }
+    }
+}
+
+// Makes the record at index safe to modify in place. Writers must be
+// serialized while views are open: by the store lock, by append_copy_lock
+// for session appends, or by running on a single thread.
+void pool_prepare_write(Pool *pool, int which, int index) {
+    if (atomic_load_explicit(&live_views, memory_order_acquire) == 0) return;
+    pthread_mutex_lock(&view_lock);
+    const ReadView *v = newest_view;
+    int k = index >> pool->chunk_shift;
+    if (v != NULL && k < v->chunk_count[which] && v->chunks[which][k] == pool->chunks[k]) {
+        if (v->chunks[which] == pool->chunks) {
+            char **dir = malloc(pool->chunk_capacity * sizeof(char *));
+            if (dir == NULL) {
+                printf("Out of memory.\n");
+                exit(1);
+            }
+            memcpy(dir, pool->chunks, pool->chunk_count * sizeof(char *));
+            view_retire(pool->chunks);
+            __atomic_store_n(&pool->chunks, dir, __ATOMIC_RELEASE);
+        }
+        size_t bytes = ((size_t)1 << pool->chunk_shift) * pool->elem_size;
+        char *chunk = malloc(bytes);
+        if (chunk == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        memcpy(chunk, pool->chunks[k], bytes);
+        view_retire(pool->chunks[k]);
+        // Appenders and readers under the read lock may be looking it up.
+        __atomic_store_n(&pool->chunks[k], chunk, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&view_lock);
+}
+
+// Opens a view of the current state. The caller must keep writers out
+// while this runs, e.g. by holding store_lock for reading. Session
+// appends run under that read lock too, so the ones in flight are let
+// finish and new ones wait until the view is in place.
+ReadView *read_view_open() {
+    ReadView *v = calloc(1, sizeof(ReadView));
+    if (v == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    pthread_rwlock_wrlock(&append_lock);
+    Pool *pools[VIEW_POOLS] = { &case_pool, &case_goal_pool, &session_pool };
+    v->case_count = case_count;
+    v->patient_count = patient_count;
+    v->session_count = session_log_count;
+    for (int i = 0; i < VIEW_POOLS; i++) {
+        pool_reserve(pools[i], 0);
+        v->chunks[i] = pools[i]->chunks;
+        v->chunk_count[i] = pools[i]->chunk_count;
     }
     
-    if (supervisor_count == 0) {
-        supervisor_count = 2;
-        strcpy(supervisors[0].name, "Dr. Sarah Wilson"); 
-        supervisors[0].id = 1;
-        strcpy(supervisors[0].email, "sarah.wilson@therapy.com");
-        
-        strcpy(supervisors[1].name, "Dr. Robert Brown"); 
-        supervisors[1].id = 2;
-        strcpy(supervisors[1].email, "robert.brown@therapy.com");
+    pthread_mutex_lock(&view_lock);
+    v->epoch = ++view_epoch;
+    v->older = newest_view;
+    if (newest_view != NULL) newest_view->newer = v;
+    else oldest_view = v;
+    newest_view = v;
+    atomic_fetch_add_explicit(&live_views, 1, memory_order_release);
+    pthread_mutex_unlock(&view_lock);
+    pthread_rwlock_unlock(&append_lock);
+    return v;
+}
+
+void read_view_close(ReadView *v) {
+    pthread_mutex_lock(&view_lock);
+    if (v->older != NULL) v->older->newer = v->newer;
+    else oldest_view = v->newer;
+    if (v->newer != NULL) v->newer->older = v->older;
+    else newest_view = v->older;
+    atomic_fetch_sub_explicit(&live_views, 1, memory_order_release);
+    // A reader holding store_lock may still be on a record a session
+    // append copied, so memory is only freed while nobody holds it. If
+    // someone does, a later close or checkpoint frees it instead.
+    if (pthread_rwlock_trywrlock(&store_lock) == 0) {
+        view_reclaim();
+        pthread_rwlock_unlock(&store_lock);
+    }
+    pthread_mutex_unlock(&view_lock);
+    free(v);
+}
+
+// Makes case_at, case_goals and session_at on this thread read from v
+// (or from the live store again, for NULL).
+void read_view_enter(ReadView *v) {
+    current_view = v;
+}
+
+static inline Patient *patient_at(int index) { return pool_at(&patient_pool, index); }
+static inline Therapist *therapist_at(int index) { return pool_at(&therapist_pool, index); }
+static inline Supervisor *supervisor_at(int index) { return pool_at(&supervisor_pool, index); }
+static inline TherapyCase *case_at(int index) { return view_at(&case_pool, VIEW_CASES, index); }
+static inline TherapyGoal *case_goals(int index) { return ((CaseGoals *)view_at(&case_goal_pool, VIEW_GOALS, index))->goals; }
+static inline TherapySession *session_at(int index) { return view_at(&session_pool, VIEW_SESSIONS, index); }
+
+// Writers go through these for records that already existed.
+static inline TherapyCase *case_for_write(int index) {
+    pool_prepare_write(&case_pool, VIEW_CASES, index);
+    return pool_at(&case_pool, index);
+}
+
+static inline TherapyGoal *case_goals_for_write(int index) {
+    pool_prepare_write(&case_goal_pool, VIEW_GOALS, index);
+    return ((CaseGoals *)pool_at(&case_goal_pool, index))->goals;
+}
+
+static inline TherapySession *session_for_write(int index) {
+    pool_prepare_write(&session_pool, VIEW_SESSIONS, index);
+    return pool_at(&session_pool, index);
+}
+
+void str_heap_add_chunk() {
+    if (string_heap.chunk_count == string_heap.chunk_capacity) {
+        // As with pools, the old directory is left for readers that may
+        // still hold it (read views do not take the store lock).
+        int capacity = string_heap.chunk_capacity ? string_heap.chunk_capacity * 2 : 16;
+        char **chunks = malloc(capacity * sizeof(char *));
+        if (chunks == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        if (string_heap.chunk_count > 0) memcpy(chunks, string_heap.chunks, string_heap.chunk_count * sizeof(char *));
+        __atomic_store_n(&string_heap.chunks, chunks, __ATOMIC_RELEASE);
+        string_heap.chunk_capacity = capacity;
     }
     
-    int choice;
-    int id;
+    char *chunk = malloc(STR_CHUNK_BYTES);
+    if (chunk == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    string_heap.chunks[string_heap.chunk_count++] = chunk;
+    string_heap.used = 0;
+}
+
+static int text_dict_find(const TextDictionary *d, const char *word, size_t len) {
+    if (d->table_capacity == 0) return -1;
+    uint32_t mask = d->table_capacity - 1;
+    for (uint32_t h = text_hash(word, len) & mask; d->table[h] != 0; h = (h + 1) & mask) {
+        uint32_t id = d->table[h] - 1;
+        uint32_t start = d->offsets[id];
+        if (d->offsets[id + 1] - start == len && memcmp(d->chars + start, word, len) == 0) return (int)id;
+    }
+    return -1;
+}
+
+void text_dict_free(TextDictionary *d) {
+    free(d->chars);
+    free(d->offsets);
+    free(d->table);
+    memset(d, 0, sizeof(*d));
+}
+
+// Takes ownership of chars and offsets.
+void text_dict_build(TextDictionary *d, char *chars, uint32_t *offsets, uint32_t count, uint32_t version) {
+    memset(d, 0, sizeof(*d));
+    d->version = version;
+    if (count == 0) {
+        free(chars);
+        free(offsets);
+        return;
+    }
     
-    print_menu_header("Speech Language Therapy Clinical Services Software");
+    uint32_t capacity = 64;
+    while (capacity < count * 2) capacity *= 2;
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (table == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (uint32_t id = 0; id < count; id++) {
+        uint32_t h = text_hash(chars + offsets[id], offsets[id + 1] - offsets[id]) & (capacity - 1);
+        while (table[h] != 0) h = (h + 1) & (capacity - 1);
+        table[h] = id + 1;
+    }
+    d->chars = chars;
+    d->offsets = offsets;
+    d->count = count;
+    d->table = table;
+    d->table_capacity = capacity;
+}
+
+// Returns the encoded length, or 0 when encoding would not make the text
+// any shorter. *literal gets the bytes that went in as literals.
+static size_t text_encode(const TextDictionary *d, const char *text, size_t len, unsigned char *out, size_t *literal) {
+    size_t n = 0, pending = 0, i = 0;
+    bool after_word = false;
+    *literal = 0;
     
-    while(1) {
-        printf("\nMain Menu:\n");
-        printf("1. Staff Login\n");
-        printf("2. Allocate New Case\n");
-        printf("3. Create/Modify Therapy Plan\n");
-        printf("4. Record Therapy Session\n");
-        printf("5. Generate Progress Report\n");
-        printf("6. Evaluate Case\n");
-        printf("7. View Case Details\n");
-        printf("8. List/Search Cases\n");
-        printf("9. Close Case\n");
-        printf("10. Save & Exit\n");
-        printf("Enter your choice: ");
-        
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input. Please enter a number.\n");
-            clear_input_buffer();
+    while (i <= len) {
+        size_t j = i;
+        int id = -1;
+        if (i < len && isalpha((unsigned char)text[i])) {
+            while (j < len && isalpha((unsigned char)text[j])) j++;
+            if (j - i <= TEXT_WORD_MAX) id = text_dict_find(d, text + i, j - i);
+            if (id < 0) {
+                i = j;
+                continue;
+            }
+        } else if (i < len) {
+            i++;
             continue;
         }
         
-        switch(choice) {
-            case 1:
-                printf("Enter your ID (1-%d for therapists, %d+ for supervisors): ", 
-                      therapist_count, therapist_count+1);
-                scanf("%d", &id);
-                if (id <= therapist_count) {
-                    therapist_dashboard(id);
-                } else if (id <= therapist_count + supervisor_count) {
-                    supervisor_dashboard(id);
-                } else {
-                    printf("Invalid ID.\n");
-                }
-                break;
-            case 2:
-                printf("Auto-allocate therapist? (1=Yes, 0=No): ");
-                int auto_s;
-                scanf("%d", &auto_s);
-                allocate_case(auto_s);
-                break;
-            case 3:
-                printf("Enter case index: ");
-                scanf("%d", &id);
-                create_therapy_plan(id);
-                break;
-            case 4:
-                printf("Enter case index: ");
-                scanf("%d", &id);
-                record_session(id);
-                break;
-            case 5:
-                printf("Enter case index: ");
-                scanf("%d", &id);
-                printf("Export to file? (1=Yes, 0=No): ");
-                int export;
-                scanf("%d", &export);
-                generate_progress_report(id, export);
-                break;
-            case 6:
-                printf("Enter case index: ");
-                scanf("%d", &id);
-                evaluate_case(id);
-                break;
-            case 7:
-                printf("Enter case index: ");
-                scanf("%d", &id);
-                view_case_details(id);
-                break;
-            case 8:
-                search_cases();
-                break;
-            case 9:
-                printf("Enter case index to close: ");
-                scanf("%d", &id);
-                close_case(id);
-                break;
-            case 10:
-                save_data();
-                printf("Data saved. Exiting...\n");
-                exit(0);
-            default:
-                printf("Invalid choice. Please try again.\n");
+        // Flush the literal bytes since the last word, unless they are
+        // the single space the decoder puts back between two words.
+        size_t lit = i - pending;
+        if (id >= 0 && after_word && lit == 1 && text[pending] == ' ') lit = 0;
+        while (lit > 0) {
+            size_t run = lit < TEXT_LITERAL_MAX ? lit : TEXT_LITERAL_MAX;
+            if (n + run + 1 >= len) return 0;
+            out[n++] = (unsigned char)(0xC0 | (run - 1));
+            memcpy(out + n, text + pending, run);
+            n += run;
+            *literal += run;
+            pending += run;
+            lit -= run;
+            after_word = false;
+        }
+        if (id < 0) break;
+        
+        if (n + 2 >= len) return 0;
+        if (id < TEXT_DICT_SHORT) {
+            out[n++] = (unsigned char)id;
+        } else {
+            out[n++] = (unsigned char)(0x80 | ((id - TEXT_DICT_SHORT) >> 8));
+            out[n++] = (unsigned char)((id - TEXT_DICT_SHORT) & 0xff);
         }
+        after_word = true;
+        i = pending = j;
     }
-    
-    return 0;
+    return n;
 }
 
-void load_data() {
-    FILE *file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        return;
+// Decodes into out, which holds size bytes; longer text is cut short.
+static void text_decode(const TextDictionary *d, const unsigned char *in, size_t len, char *out, size_t size) {
+    size_t i = 0, n = 0, limit = size - 1;
+    bool after_word = false;
+    while (i < len && n < limit) {
+        unsigned b = in[i++];
+        const char *bytes;
+        size_t count;
+        if (b >= 0xC0) {
+            count = (b & 0x3F) + 1;
+            if (count > len - i) break;
+            bytes = (const char *)in + i;
+            i += count;
+            after_word = false;
+        } else {
+            uint32_t id = b;
+            if (b >= 0x80) {
+                if (i == len) break;
+                id = TEXT_DICT_SHORT + (((b & 0x3F) << 8) | in[i++]);
+            }
+            if (id >= d->count) break;
+            if (after_word) out[n++] = ' ';
+            bytes = d->chars + d->offsets[id];
+            count = d->offsets[id + 1] - d->offsets[id];
+            after_word = true;
+        }
+        if (count > limit - n) count = limit - n;
+        memcpy(out + n, bytes, count);
+        n += count;
     }
+    out[n] = '\0';
+}
+
+// Safe to call from concurrent session appends. Readers need no lock:
+// a ref is only published after its entry has been written.
+StrRef str_put(const char *text) {
+    size_t len = strlen(text);
+    if (len == 0) return 0;
+    if (len > STR_MAX_LEN) len = STR_MAX_LEN;
     
-    if (fread(&patient_count, sizeof(int), 1, file) != 1) goto error;
-    if (fread(&therapist_count, sizeof(int), 1, file) != 1) goto error;
-    if (fread(&supervisor_count, sizeof(int), 1, file) != 1) goto error;
-    if (fread(&case_count, sizeof(int), 1, file) != 1) goto error;
-    
-    if (fread(patients, sizeof(Patient), patient_count, file) != patient_count) goto error;
-    if (fread(therapists, sizeof(Therapist), therapist_count, file) != therapist_count) goto error;
-    if (fread(supervisors, sizeof(Supervisor), supervisor_count, file) != supervisor_count) goto error;
-    if (fread(cases, sizeof(TherapyCase), case_count, file) != case_count) goto error;
+    pthread_mutex_lock(&string_heap_lock);
+    // The first slot of the heap is reserved so that ref 0 means "empty".
+    if (string_heap.chunk_count == 0) {
+        str_heap_add_chunk();
+        string_heap.used = 4;
+    }
+    if (string_heap.used + len + 3 > STR_CHUNK_BYTES) {
+        str_heap_add_chunk();
+    }
     
-    fclose(file);
-    return;
+    // Room is made for the plain text, which the encoding never exceeds.
+    char *slot = string_heap.chunks[string_heap.chunk_count - 1] + string_heap.used;
+    size_t literal = len;
+    size_t packed = text_dict.count > 0 ? text_encode(&text_dict, text, len, (unsigned char *)slot + 2, &literal) : 0;
+    unsigned header = (unsigned)len;
+    if (packed > 0) {
+        header = (unsigned)packed | STR_PACKED;
+        len = packed;
+    } else {
+        literal = len;
+        memcpy(slot + 2, text, len);
+    }
+    slot[0] = (char)(header & 0xff);
+    slot[1] = (char)(header >> 8);
+    slot[2 + len] = '\0';
+    text_literal_bytes += literal;
     
-error:
-    printf("Error loading data. Starting with empty database.\n");
-    fclose(file);
-    patient_count = therapist_count = supervisor_count = case_count = 0;
+    StrRef ref = ((StrRef)(string_heap.chunk_count - 1) << STR_CHUNK_SHIFT) | string_heap.used;
+    string_heap.used += len + 3;
+    pthread_mutex_unlock(&string_heap_lock);
+    return ref;
 }
 
-void save_data() {
-    FILE *file = fopen(FILENAME, "wb");
-    if (file == NULL) {
-        printf("Error saving data!\n");
-        return;
+static const char *str_read(const StringHeap *heap, const TextDictionary *d, StrRef ref, char *buf, size_t size) {
+    if (ref == 0) return "";
+    char **chunks = __atomic_load_n(&heap->chunks, __ATOMIC_ACQUIRE);
+    const unsigned char *slot = (const unsigned char *)chunks[ref >> STR_CHUNK_SHIFT] + (ref & (STR_CHUNK_BYTES - 1));
+    unsigned header = slot[0] | (slot[1] << 8);
+    if (!(header & STR_PACKED) || d->count == 0) return (const char *)slot + 2;
+    text_decode(d, slot + 2, header & STR_MAX_LEN, buf, size);
+    return buf;
+}
+
+// Plain entries are returned in place; packed ones are decoded into buf,
+// which holds size bytes (STR_MAX_LEN + 1 for the full text). Either way
+// the result stays valid for as long as buf does.
+const char *str_get(StrRef ref, char *buf, size_t size) {
+    return str_read(&string_heap, &text_dict, ref, buf, size);
+}
+
+typedef struct {
+    char *chars;
+    size_t chars_len, chars_capacity;
+    uint32_t *offsets, *counts;
+    uint32_t count, capacity;
+    uint32_t *table;
+    uint32_t table_capacity;
+} WordCounts;
+
+static void word_counts_grow(WordCounts *wc) {
+    uint32_t capacity = wc->table_capacity ? wc->table_capacity * 2 : 1024;
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (table == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (uint32_t id = 0; id < wc->count; id++) {
+        uint32_t h = text_hash(wc->chars + wc->offsets[id], wc->offsets[id + 1] - wc->offsets[id]) & (capacity - 1);
+        while (table[h] != 0) h = (h + 1) & (capacity - 1);
+        table[h] = id + 1;
+    }
+    free(wc->table);
+    wc->table = table;
+    wc->table_capacity = capacity;
+}
+
+static void word_counts_add(WordCounts *wc, const char *word, size_t len) {
+    if ((wc->count + 1) * 2 > wc->table_capacity) word_counts_grow(wc);
+    uint32_t mask = wc->table_capacity - 1;
+    uint32_t h = text_hash(word, len) & mask;
+    for (; wc->table[h] != 0; h = (h + 1) & mask) {
+        uint32_t id = wc->table[h] - 1;
+        uint32_t start = wc->offsets[id];
+        if (wc->offsets[id + 1] - start == len && memcmp(wc->chars + start, word, len) == 0) {
+            wc->counts[id]++;
+            return;
+        }
     }
     
-    fwrite(&patient_count, sizeof(int), 1, file);
-    fwrite(&therapist_count, sizeof(int), 1, file);
-    fwrite(&supervisor_count, sizeof(int), 1, file);
-    fwrite(&case_count, sizeof(int), 1, file);
-    
-    fwrite(patients, sizeof(Patient), patient_count, file);
-    fwrite(therapists, sizeof(Therapist), therapist_count, file);
-    fwrite(supervisors, sizeof(Supervisor), supervisor_count, file);
-    fwrite(cases, sizeof(TherapyCase), case_count, file);
-    
-    fclose(file);
+    if (wc->count + 2 > wc->capacity) {
+        wc->capacity = wc->capacity ? wc->capacity * 2 : 1024;
+        wc->offsets = realloc(wc->offsets, (wc->capacity + 1) * sizeof(uint32_t));
+        wc->counts = realloc(wc->counts, wc->capacity * sizeof(uint32_t));
+    }
+    if (wc->chars_len + len > wc->chars_capacity) {
+        wc->chars_capacity = wc->chars_capacity ? wc->chars_capacity * 2 : 16384;
+        wc->chars = realloc(wc->chars, wc->chars_capacity);
+    }
+    if (wc->offsets == NULL || wc->counts == NULL || wc->chars == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    if (wc->count == 0) wc->offsets[0] = 0;
+    memcpy(wc->chars + wc->chars_len, word, len);
+    wc->chars_len += len;
+    wc->offsets[wc->count + 1] = (uint32_t)wc->chars_len;
+    wc->counts[wc->count] = 1;
+    wc->table[h] = ++wc->count;
 }
 
-void allocate_case(bool auto_allocate) {
-    if (patient_count >= MAX_PATIENTS) {
-        printf("Maximum patient limit reached.\n");
-        return;
+static void visit_text_refs(void (*fn)(StrRef *ref, void *ctx), void *ctx) {
+    for (int i = 0; i < patient_count; i++) fn(&patient_at(i)->diagnosis, ctx);
+    for (int i = 0; i < case_count; i++) {
+        TherapyGoal *goals = ((CaseGoals *)pool_at(&case_goal_pool, i))->goals;
+        int goal_count = ((TherapyCase *)pool_at(&case_pool, i))->goal_count;
+        for (int g = 0; g < goal_count; g++) fn(&goals[g].description, ctx);
+    }
+    for (int i = 0; i < session_log_count; i++) {
+        TherapySession *s = pool_at(&session_pool, i);
+        fn(&s->activities, ctx);
+        fn(&s->observations, ctx);
+        fn(&s->supervisor_feedback, ctx);
     }
+}
+
+// The heap and dictionary text is read from while training.
+typedef struct {
+    StringHeap heap;
+    TextDictionary dict;
+    WordCounts words;
+    char text[STR_MAX_LEN + 1];
+} TextTraining;
+
+static void count_words(StrRef *ref, void *ctx) {
+    TextTraining *t = ctx;
+    const char *text = str_read(&t->heap, &t->dict, *ref, t->text, sizeof(t->text));
+    while (*text) {
+        if (!isalpha((unsigned char)*text)) {
+            text++;
+            continue;
+        }
+        const char *start = text;
+        while (isalpha((unsigned char)*text)) text++;
+        if (text - start <= TEXT_WORD_MAX) word_counts_add(&t->words, start, text - start);
+    }
+}
+
+static void repack_text(StrRef *ref, void *ctx) {
+    TextTraining *t = ctx;
+    if (*ref != 0) *ref = str_put(str_read(&t->heap, &t->dict, *ref, t->text, sizeof(t->text)));
+}
+
+static const uint32_t *word_rank_counts;
+
+static int compare_word_rank(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    if (word_rank_counts[x] != word_rank_counts[y]) return word_rank_counts[x] > word_rank_counts[y] ? -1 : 1;
+    return x < y ? -1 : 1;
+}
+
+static size_t heap_bytes(const StringHeap *heap) {
+    return heap->chunk_count ? (size_t)(heap->chunk_count - 1) * STR_CHUNK_BYTES + heap->used : 0;
+}
+
+// Trains a new dictionary version from the words currently stored and
+// rewrites every string, and the text index's references to them,
+// against it. Nothing may read the store meanwhile, and no read view may
+// be open, since views still see the old references. Returns the number
+// of dictionary words, or 0 if nothing was worth encoding.
+uint32_t text_store_train(size_t *bytes_before, size_t *bytes_after) {
+    *bytes_before = *bytes_after = heap_bytes(&string_heap);
+    if (string_heap.chunk_count == 0) return 0;
     
-    print_menu_header("Allocate New Case");
+    TextTraining *t = calloc(1, sizeof(TextTraining));
+    if (t == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    t->heap = string_heap;
+    t->dict = text_dict;
+    visit_text_refs(count_words, t);
+    WordCounts *wc = &t->words;
     
-    Patient *p = &patients[patient_count];
-    p->id = patient_count + 1;
+    // Words seen once save nothing; the most frequent get one-byte ids.
+    uint32_t *rank = malloc((wc->count + 1) * sizeof(uint32_t));
+    if (rank == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    uint32_t kept = 0;
+    for (uint32_t id = 0; id < wc->count; id++) {
+        if (wc->counts[id] >= 2) rank[kept++] = id;
+    }
+    word_rank_counts = wc->counts;
+    qsort(rank, kept, sizeof(uint32_t), compare_word_rank);
+    if (kept > TEXT_DICT_MAX) kept = TEXT_DICT_MAX;
     
-    printf("Enter patient name: ");
-    clear_input_buffer();
-    fgets(p->name, sizeof(p->name), stdin);
-    p->name[strcspn(p->name, "\n")] = '\0';
+    size_t chars_len = 0;
+    for (uint32_t i = 0; i < kept; i++) chars_len += wc->offsets[rank[i] + 1] - wc->offsets[rank[i]];
+    char *chars = malloc(chars_len + 1);
+    uint32_t *offsets = malloc((kept + 1) * sizeof(uint32_t));
+    if (chars == NULL || offsets == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    offsets[0] = 0;
+    for (uint32_t i = 0; i < kept; i++) {
+        uint32_t start = wc->offsets[rank[i]], len = wc->offsets[rank[i] + 1] - start;
+        memcpy(chars + offsets[i], wc->chars + start, len);
+        offsets[i + 1] = offsets[i] + len;
+    }
+    free(rank);
+    free(wc->chars);
+    free(wc->offsets);
+    free(wc->counts);
+    free(wc->table);
+    if (kept == 0) {
+        free(chars);
+        free(offsets);
+        free(t);
+        return 0;
+    }
     
-    printf("Enter diagnosis: ");
-    fgets(p->diagnosis, sizeof(p->diagnosis), stdin);
-    p->diagnosis[strcspn(p->diagnosis, "\n")] = '\0';
+    // Text index documents keep pointing at the field they came from;
+    // stale ones no longer have text of their own.
+    uint8_t *live = calloc(text_doc_count + 1, 1);
+    if (live == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (uint32_t d = 0; d < text_doc_count; d++) live[d] = text_owner_ref(text_docs[d].owner) == text_docs[d].ref;
     
-    printf("Enter age: ");
-    scanf("%d", &p->age);
+    text_dict_build(&text_dict, chars, offsets, kept, t->dict.version + 1);
+    memset(&string_heap, 0, sizeof(string_heap));
+    text_literal_bytes = 0;
+    visit_text_refs(repack_text, t);
+    for (uint32_t d = 0; d < text_doc_count; d++) {
+        text_docs[d].ref = live[d] ? text_owner_ref(text_docs[d].owner) : TEXT_DOC_STALE;
+    }
+    free(live);
     
-    printf("Enter gender (M/F/O): ");
-    scanf(" %c", &p->gender);
-    p->gender = toupper(p->gender);
+    for (int i = 0; i < t->heap.chunk_count; i++) {
+        char *chunk = t->heap.chunks[i];
+        if (data_map == NULL || chunk < data_map || chunk >= data_map + data_map_size) free(chunk);
+    }
+    free(t->heap.chunks);
+    text_dict_free(&t->dict);
+    free(t);
     
-    printf("Enter contact number: ");
-    scanf("%14s", p->contact);
+    *bytes_after = text_trained_heap_bytes = heap_bytes(&string_heap);
+    text_trained_literal_bytes = text_literal_bytes;
+    return kept;
+}
+
+// Retraining pays off once most of what was written since the last
+// training went in uncompressed, and that amounts to a fair share of the
+// store, so the cost of re-encoding stays proportional to growth.
+bool text_retrain_due() {
+    size_t added = heap_bytes(&string_heap) - text_trained_heap_bytes;
+    size_t literal = text_literal_bytes - text_trained_literal_bytes;
+    return literal >= TEXT_RETRAIN_MIN_BYTES && literal * 2 >= added && literal * 4 >= text_trained_heap_bytes;
+}
+
+static inline unsigned id_hash(int id, int capacity) {
+    return ((unsigned)id * 2654435761u) & (capacity - 1);
+}
+
+void id_index_grow(IdIndex *index) {
+    int old_capacity = index->capacity;
+    int *old_keys = index->keys;
+    int *old_slots = index->slots;
     
-    printf("Enter admission date (YYYY-MM-DD): ");
-    char date[11];
-    scanf("%10s", date);
-    while (!validate_date(date)) {
-        printf("Invalid date format. Please use YYYY-MM-DD: ");
-        scanf("%10s", date);
+    index->capacity = old_capacity ? old_capacity * 2 : 64;
+    index->keys = calloc(index->capacity, sizeof(int));
+    index->slots = malloc(index->capacity * sizeof(int));
+    if (index->keys == NULL || index->slots == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
     }
-    strcpy(p->admission_date, date);
+    index->size = 0;
     
-    int therapist_id;
-    if (auto_allocate) {
-        therapist_id = find_available_therapist();
-        if (therapist_id == -1) {
-            printf("No available therapists found. Please try manual allocation.\n");
-            return;
-        }
-        printf("Auto-assigned therapist: %s (ID: %d)\n", 
-               therapists[therapist_id-1].name, therapist_id);
-    } else {
-        printf("\nAvailable Therapists:\n");
-        for (int i = 0; i < therapist_count; i++) {
-            printf("%d. %s (%s) - Current cases: %d\n", 
-                  therapists[i].id, therapists[i].name, 
-                  therapists[i].specialization, therapists[i].current_cases);
-        }
-        
-        printf("\nEnter therapist ID: ");
-        scanf("%d", &therapist_id);
+    for (int i = 0; i < old_capacity; i++) {
+        if (old_keys[i] != 0) id_index_put(index, old_keys[i], old_slots[i]);
     }
-    printf("\nAvailable Supervisors:\n");
-    for (int i = 0; i < supervisor_count; i++) {
-        printf("%d. %s\n", supervisors[i].id, supervisors[i].name);
+    if (!index->mapped) {
+        free(old_keys);
+        free(old_slots);
     }
+    index->mapped = false;
+}
+
+void id_index_put(IdIndex *index, int id, int slot) {
+    if (id <= 0) return;
+    if ((index->size + 1) * 4 > index->capacity * 3) id_index_grow(index);
     
-    int supervisor_id;
-    printf("\nEnter supervisor ID: ");
-    scanf("%d", &supervisor_id);
-    
-    TherapyCase *c = &cases[case_count];
-    c->id = case_count + 1;
-    c->patient_id = p->id;
-    c->therapist_id = therapist_id;
-    c->supervisor_id = supervisor_id;
-    c->goal_count = 0;
-    c->session_count = 0;
-    c->is_active = true;
-    c->clinical_rating = 0.0;
-    strcpy(c->start_date, date);
-    strcpy(c->end_date, "");
-    strcpy(c->status, "Active");
-    
-    therapists[therapist_id-1].current_cases++;
-    
-    printf("\nCase allocated successfully. Case ID: %d\n", c->id);
-    case_count++;
-    patient_count++;
+    unsigned h = id_hash(id, index->capacity);
+    while (index->keys[h] != 0 && index->keys[h] != id) {
+        h = (h + 1) & (index->capacity - 1);
+    }
+    if (index->keys[h] == 0) {
+        index->keys[h] = id;
+        index->size++;
+    }
+    index->slots[h] = slot;
 }
 
-int find_available_therapist() {
-    int min_cases = MAX_PATIENTS;
-    int selected_id = -1;
+int id_index_get(IdIndex *index, int id) {
+    if (index->capacity == 0 || id <= 0) return -1;
     
-    for (int i = 0; i < therapist_count; i++) {
-        if (therapists[i].current_cases < min_cases) {
-            min_cases = therapists[i].current_cases;
-            selected_id = therapists[i].id;
+    unsigned h = id_hash(id, index->capacity);
+    while (index->keys[h] != 0) {
+        if (index->keys[h] == id) {
+            METRIC_ADD(MC_ID_INDEX_HITS, 1);
+            return index->slots[h];
         }
+        h = (h + 1) & (index->capacity - 1);
     }
-    
-    return selected_id;
+    METRIC_ADD(MC_ID_INDEX_MISSES, 1);
+    return -1;
 }
 
-void create_therapy_plan(int case_index) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
+// Primary indexes mapped from a snapshot are already complete; only the
+// ones that disagree with their store (old formats, seeding) are rebuilt.
+void rebuild_indexes() {
+    if (patient_index.size != patient_count) {
+        for (int i = 0; i < patient_count; i++) id_index_put(&patient_index, patient_at(i)->id, i);
     }
-    
-    TherapyCase *c = &cases[case_index];
-    print_menu_header("Create/Modify Therapy Plan");
-    
-    printf("Case ID: %d | Patient ID: %d\n", c->id, c->patient_id);
-    printf("Current goals: %d\n", c->goal_count);
-    
-    if (c->goal_count > 0) {
-        printf("\nExisting Goals:\n");
-        for (int i = 0; i < c->goal_count; i++) {
-            printf("%d. %s (Target: %d sessions, Achieved: %d, Status: %s)\n", 
-                  c->goals[i].id, c->goals[i].description,
-                  c->goals[i].target_sessions, c->goals[i].achieved,
-                  c->goals[i].status);
+    if (therapist_index.size != therapist_count) {
+        for (int i = 0; i < therapist_count; i++) id_index_put(&therapist_index, therapist_at(i)->id, i);
+    }
+    if (supervisor_index.size != supervisor_count) {
+        for (int i = 0; i < supervisor_count; i++) id_index_put(&supervisor_index, supervisor_at(i)->id, i);
+    }
+    if (case_index.size != case_count) {
+        for (int i = 0; i < case_count; i++) id_index_put(&case_index, case_at(i)->id, i);
+    }
+}
+
+// Inside a read view the patient index may be rehashed underneath us, so
+// patients are found in the store itself: ids are handed out in slot
+// order, so the slot is normally id - 1 and otherwise found by bisection.
+static Patient *view_find_patient(int id) {
+    int n = current_view->patient_count;
+    if (id >= 1 && id <= n && patient_at(id - 1)->id == id) return patient_at(id - 1);
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (patient_at(mid)->id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && patient_at(lo)->id == id ? patient_at(lo) : NULL;
+}
+
+Patient *find_patient(int id) {
+    if (current_view != NULL) return view_find_patient(id);
+    int slot = id_index_get(&patient_index, id);
+    return slot < 0 ? NULL : patient_at(slot);
+}
+
+Therapist *find_therapist(int id) {
+    int slot = id_index_get(&therapist_index, id);
+    return slot < 0 ? NULL : therapist_at(slot);
+}
+
+Supervisor *find_supervisor(int id) {
+    int slot = id_index_get(&supervisor_index, id);
+    return slot < 0 ? NULL : supervisor_at(slot);
+}
+
+int find_case(int id) {
+    return id_index_get(&case_index, id);
+}
+
+void case_list_add(CaseList *list, int slot) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        int *items = realloc(list->items, capacity * sizeof(int));
+        if (items == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
         }
-        
-        printf("\n1. Add new goals\n2. Modify existing goals\n3. Cancel\nChoice: ");
-        int choice;
-        scanf("%d", &choice);
-        
-        if (choice == 2) {
-            printf("Enter goal number to modify: ");
-            int goal_num;
-            scanf("%d", &goal_num);
-            if (goal_num < 1 || goal_num > c->goal_count) {
-                printf("Invalid goal number.\n");
-                return;
-            }
-            
-            TherapyGoal *g = &c->goals[goal_num-1];
-            printf("\nEditing Goal %d:\n", goal_num);
-            printf("Current description: %s\n", g->description);
-            printf("New description (or press enter to keep): ");
-            clear_input_buffer();
-            char new_desc[200];
-            fgets(new_desc, sizeof(new_desc), stdin);
-            new_desc[strcspn(new_desc, "\n")] = '\0';
-            if (strlen(new_desc) > 0) {
-                strcpy(g->description, new_desc);
-            }
-            
-            printf("Current target sessions: %d\n", g->target_sessions);
-            printf("New target sessions (or 0 to keep): ");
-            int new_target;
-            scanf("%d", &new_target);
-            if (new_target > 0) {
-                g->target_sessions = new_target;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = slot;
+}
+
+void posting_add(PostingIndex *index, int key, int slot) {
+    int n = id_index_get(&index->keys, key);
+    if (n < 0) {
+        if (index->list_count == index->list_capacity) {
+            int capacity = index->list_capacity ? index->list_capacity * 2 : 16;
+            CaseList *lists = realloc(index->lists, capacity * sizeof(CaseList));
+            if (lists == NULL) {
+                printf("Out of memory.\n");
+                exit(1);
             }
-            
-            printf("Goal updated successfully.\n");
-            return;
-        } else if (choice == 3) {
-            return;
+            index->lists = lists;
+            index->list_capacity = capacity;
         }
+        n = index->list_count++;
+        memset(&index->lists[n], 0, sizeof(CaseList));
+        id_index_put(&index->keys, key, n);
     }
+    case_list_add(&index->lists[n], slot);
+}
+
+// Secondary indexes are built on first use rather than at startup, so
+// opening a large snapshot does not pay for them up front.
+void ensure_secondary_indexes() {
+    if (secondary_indexes_ready) return;
+    secondary_indexes_ready = true;
+    for (int i = 0; i < case_count; i++) index_case(i);
+}
+
+CaseList *posting_get(PostingIndex *index, int key) {
+    ensure_secondary_indexes();
+    int n = id_index_get(&index->keys, key);
+    METRIC_ADD(n < 0 ? MC_POSTING_MISSES : MC_POSTING_HITS, 1);
+    return n < 0 ? NULL : &index->lists[n];
+}
+
+static inline bool bitmap_test(const StatusBitmap *bm, int slot) {
+    int word = slot >> 6;
+    return word < bm->word_capacity && (bm->words[word] >> (slot & 63)) & 1;
+}
+
+void status_set(int status, int slot, bool on) {
+    if (!secondary_indexes_ready || status <= 0 || status >= CASE_STATUS_COUNT) return;
+    StatusBitmap *bm = &status_bitmaps[status];
     
-    int goal_count;
-    printf("\nEnter number of therapy goals to add (max %d): ", MAX_GOALS - c->goal_count);
-    scanf("%d", &goal_count);
-    
-    if (goal_count <= 0 || goal_count > (MAX_GOALS - c->goal_count)) {
-        printf("Invalid number of goals.\n");
-        return;
+    int word = slot >> 6;
+    if (word >= bm->word_capacity) {
+        if (!on) return;
+        int capacity = bm->word_capacity ? bm->word_capacity : 16;
+        while (capacity <= word) capacity *= 2;
+        uint64_t *words = realloc(bm->words, capacity * sizeof(uint64_t));
+        if (words == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        memset(words + bm->word_capacity, 0, (capacity - bm->word_capacity) * sizeof(uint64_t));
+        bm->words = words;
+        bm->word_capacity = capacity;
     }
     
-    clear_input_buffer();
-    for (int i = 0; i < goal_count; i++) {
-        TherapyGoal *g = &c->goals[c->goal_count + i];
-        g->id = c->goal_count + i + 1;
-        
-        printf("\nGoal %d:\n", g->id);
-        printf("Enter description: ");
-        fgets(g->description, sizeof(g->description), stdin);
-        g->description[strcspn(g->description, "\n")] = '\0';
-        
-        printf("Enter target sessions: ");
-        scanf("%d", &g->target_sessions);
-        clear_input_buffer();
-        
-        g->achieved = 0;
-        strcpy(g->status, "Not Started");
+    uint64_t bit = (uint64_t)1 << (slot & 63);
+    if (on && !(bm->words[word] & bit)) {
+        bm->words[word] |= bit;
+        bm->count++;
+    } else if (!on && (bm->words[word] & bit)) {
+        bm->words[word] &= ~bit;
+        bm->count--;
     }
-    
-    c->goal_count += goal_count;
-    printf("\nTherapy plan updated successfully. Total goals: %d\n", c->goal_count);
 }
 
-void record_session(int case_index) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
-    }
-    
-    TherapyCase *c = &cases[case_index];
-    if (!c->is_active) {
-        printf("This case is not active. Cannot record sessions.\n");
-        return;
+// Cases in a status, clinic-wide or among the given cases.
+int status_count(int status, const CaseList *within) {
+    ensure_secondary_indexes();
+    if (status <= 0 || status >= CASE_STATUS_COUNT) return 0;
+    const StatusBitmap *bm = &status_bitmaps[status];
+    if (within == NULL) return bm->count;
+    int count = 0;
+    for (int k = 0; k < within->count; k++) count += bitmap_test(bm, within->items[k]);
+    return count;
+}
+
+void index_case(int slot) {
+    if (!secondary_indexes_ready) return;
+    TherapyCase *c = case_at(slot);
+    posting_add(&cases_by_patient, c->patient_id, slot);
+    posting_add(&cases_by_therapist, c->therapist_id, slot);
+    posting_add(&cases_by_supervisor, c->supervisor_id, slot);
+    status_set(c->status, slot, true);
+}
+
+// First position at or after 'from' in a sorted list whose slot is >= slot.
+static int case_list_seek(const CaseList *list, int from, int slot) {
+    int lo = from, hi = list->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (list->items[mid] < slot) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
+}
+
+// Answers a conjunctive case filter from the indexes. The shortest posting
+// list drives the scan; the other lists are probed with forward seeks and
+// the status is checked against its bitmap.
+int query_cases(const CaseQuery *q, void (*emit)(int slot, void *ctx), void *ctx) {
+    METRIC_SCOPE(OP_QUERY_CASES);
+    const CaseList *lists[3];
+    int list_count = 0;
+    int keys[3] = { q->patient_id, q->therapist_id, q->supervisor_id };
+    PostingIndex *indexes[3] = { &cases_by_patient, &cases_by_therapist, &cases_by_supervisor };
     
-    if (c->session_count >= MAX_SESSIONS) {
-        printf("Maximum sessions limit reached for this case.\n");
-        return;
+    for (int i = 0; i < 3; i++) {
+        if (keys[i] == 0) continue;
+        CaseList *list = posting_get(indexes[i], keys[i]);
+        if (list == NULL) return 0;
+        lists[list_count++] = list;
     }
     
-    print_menu_header("Record Therapy Session");
-    
-    int session_idx = c->session_count;
-    TherapySession *s = &c->sessions[session_idx];
-    s->session_id = session_idx + 1;
-    s->patient_id = c->patient_id;
-    s->therapist_id = c->therapist_id;
-    s->supervisor_reviewed = false;
-    
-    
-    printf("Enter session date (YYYY-MM-DD) or 'today' for current date: ");
-    char date_input[11];
-    scanf("%10s", date_input);
-    
-    if (strcmp(date_input, "today") == 0) {
-        time_t t = time(NULL);
-        struct tm tm = *localtime(&t);
-        sprintf(s->date, "%d-%02d-%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-    } else {
-        while (!validate_date(date_input)) {
-            printf("Invalid date format. Please use YYYY-MM-DD: ");
-            scanf("%10s", date_input);
-        }
-        strcpy(s->date, date_input);
+    ensure_secondary_indexes();
+    const StatusBitmap *bm = NULL;
+    if (q->status != 0) {
+        if (q->status < 0 || q->status >= CASE_STATUS_COUNT) return 0;
+        bm = &status_bitmaps[q->status];
+        if (bm->count == 0) return 0;
     }
     
-    clear_input_buffer();
-    printf("Session Date: %s\n", s->date);
-    printf("Enter activities performed: ");
-    fgets(s->activities, sizeof(s->activities), stdin);
-    s->activities[strcspn(s->activities, "\n")] = '\0';
-    
-    printf("Enter observations: ");
-    fgets(s->observations, sizeof(s->observations), stdin);
-    s->observations[strcspn(s->observations, "\n")] = '\0';
-    
-    if (c->goal_count > 0) {
-        printf("\nUpdate goal progress? (1=Yes, 0=No): ");
-        int update;
-        scanf("%d", &update);
-        if (update) {
-            printf("Select goal to update:\n");
-            for (int i = 0; i < c->goal_count; i++) {
-                printf("%d. %s\n", c->goals[i].id, c->goals[i].description);
-            }
-            printf("Goal number: ");
-            int goal_num;
-            scanf("%d", &goal_num);
-            if (goal_num >= 1 && goal_num <= c->goal_count) {
-                c->goals[goal_num-1].achieved++;
-                if (c->goals[goal_num-1].achieved >= c->goals[goal_num-1].target_sessions) {
-                    strcpy(c->goals[goal_num-1].status, "Completed");
-                } else {
-                    strcpy(c->goals[goal_num-1].status, "In Progress");
+    int matches = 0;
+    if (list_count == 0) {
+        for (int slot = 0; slot < case_count; slot++) {
+            if (bm != NULL) {
+                // Skip empty bitmap words wholesale.
+                int word = slot >> 6;
+                if (word >= bm->word_capacity) break;
+                if ((slot & 63) == 0 && bm->words[word] == 0) {
+                    slot += 63;
+                    continue;
                 }
-                printf("Goal %d progress updated.\n", goal_num);
+                if (!bitmap_test(bm, slot)) continue;
             }
+            if (session_total(case_at(slot)) < q->min_sessions) continue;
+            emit(slot, ctx);
+            matches++;
         }
+        return matches;
     }
     
-    c->session_count++;
-    printf("\nSession recorded successfully. Total sessions: %d\n", c->session_count);
-}
-
-void generate_progress_report(int case_index, bool export_to_file) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
+    int driver = 0;
+    for (int i = 1; i < list_count; i++) {
+        if (lists[i]->count < lists[driver]->count) driver = i;
     }
     
-    TherapyCase *c = &cases[case_index];
-    print_menu_header("Progress Report");
-    
-    Patient *p = NULL;
-    for (int i = 0; i < patient_count; i++) {
-        if (patients[i].id == c->patient_id) {
-            p = &patients[i];
-            break;
+    int cursors[3] = { 0, 0, 0 };
+    for (int k = 0; k < lists[driver]->count; k++) {
+        int slot = lists[driver]->items[k];
+        bool match = true;
+        for (int i = 0; i < list_count && match; i++) {
+            if (i == driver) continue;
+            cursors[i] = case_list_seek(lists[i], cursors[i], slot);
+            match = cursors[i] < lists[i]->count && lists[i]->items[cursors[i]] == slot;
         }
+        if (!match) continue;
+        if (bm != NULL && !bitmap_test(bm, slot)) continue;
+        if (session_total(case_at(slot)) < q->min_sessions) continue;
+        emit(slot, ctx);
+        matches++;
     }
-    
-    if (p == NULL) {
-        printf("Patient not found.\n");
-        return;
-    }
-    
-    char report[5000];
-    int pos = 0;
-    
-    pos += sprintf(report + pos, "\nPROGRESS REPORT\n");
-    pos += sprintf(report + pos, "Case ID: %d\n", c->id);
-    pos += sprintf(report + pos, "Patient: %s (ID: %d)\n", p->name, p->id);
-    pos += sprintf(report + pos, "Diagnosis: %s\n", p->diagnosis);
-    pos += sprintf(report + pos, "Age: %d, Gender: %c\n", p->age, p->gender);
-    pos += sprintf(report + pos, "Admission Date: %s\n", p->admission_date);
-    
-    for (int i = 0; i < therapist_count; i++) {
-        if (therapists[i].id == c->therapist_id) {
-            pos += sprintf(report + pos, "\nTherapist: %s (%s)\n", 
-                          therapists[i].name, therapists[i].specialization);
-            break;
+    return matches;
+}
+
+// Reserves a log slot. Slots are handed out atomically, so concurrent
+// appenders never share one; a whole-log scan must not overlap appends,
+// since a reserved slot may not be linked yet. Scans run under the
+// store's write lock or, for views, after append_lock has drained them.
+int session_new(TherapyCase *c) {
+    int index = __atomic_fetch_add(&session_log_count, 1, __ATOMIC_RELAXED);
+    pool_reserve(&session_pool, index + 1);
+    TherapySession *s = session_at(index);
+    memset(s, 0, sizeof(*s));
+    s->case_id = c->id;
+    s->patient_id = c->patient_id;
+    s->therapist_id = c->therapist_id;
+    s->next_in_case = NO_SESSION;
+    return index;
+}
+
+// Publishes a filled slot at the end of the case's chain. The slot is
+// linked with a release CAS on the old tail's next_in_case (or on
+// first_session), so anyone who can reach it sees its contents.
+// last_session may briefly lag behind; whoever notices helps it along.
+// The session number is fixed by the position won, so numbers along a
+// chain are always 1, 2, 3, ...
+void session_link(TherapyCase *c, int session_index) {
+    TherapySession *s = session_at(session_index);
+    s->next_in_case = NO_SESSION;
+    while (1) {
+        int tail = __atomic_load_n(&c->last_session, __ATOMIC_ACQUIRE);
+        int expected = NO_SESSION;
+        if (tail == NO_SESSION) {
+            s->session_id = 1;
+            if (__atomic_compare_exchange_n(&c->first_session, &expected, session_index, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                __atomic_compare_exchange_n(&c->last_session, &tail, session_index, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+                break;
+            }
+            __atomic_compare_exchange_n(&c->last_session, &tail, expected, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            continue;
         }
-    }
-    
-    for (int i = 0; i < supervisor_count; i++) {
-        if (supervisors[i].id == c->supervisor_id) {
-            pos += sprintf(report + pos, "Supervisor: %s\n", supervisors[i].name);
+        
+        TherapySession *t = session_at(tail);
+        int next = __atomic_load_n(&t->next_in_case, __ATOMIC_ACQUIRE);
+        if (next != NO_SESSION) {
+            __atomic_compare_exchange_n(&c->last_session, &tail, next, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            continue;
+        }
+        s->session_id = t->session_id + 1;
+        if (__atomic_compare_exchange_n(&t->next_in_case, &expected, session_index, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            __atomic_compare_exchange_n(&c->last_session, &tail, session_index, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
             break;
         }
     }
-    
-    pos += sprintf(report + pos, "\nCase Status: %s\n", c->status);
-    pos += sprintf(report + pos, "Start Date: %s\n", c->start_date);
-    if (strlen(c->end_date) > 0) {
-        pos += sprintf(report + pos, "End Date: %s\n", c->end_date);
+    __atomic_fetch_add(&c->session_count, 1, __ATOMIC_RELEASE);
+}
+
+// Chains are walked with these, so a walk that overlaps an append sees a
+// complete prefix. session_count is bumped after linking, so a chain is
+// never shorter than a count read before walking it.
+static inline int session_first(const TherapyCase *c) {
+    return __atomic_load_n(&c->first_session, __ATOMIC_ACQUIRE);
+}
+
+static inline int session_next(int index) {
+    int next = __atomic_load_n(&session_at(index)->next_in_case, __ATOMIC_ACQUIRE);
+    // A view's chains end where its log did.
+    return current_view != NULL && next >= current_view->session_count ? NO_SESSION : next;
+}
+
+static inline int session_last(const TherapyCase *c) {
+    return __atomic_load_n(&c->last_session, __ATOMIC_ACQUIRE);
+}
+
+static inline int session_total(const TherapyCase *c) {
+    return __atomic_load_n(&c->session_count, __ATOMIC_ACQUIRE);
+}
+
+void clear_input_buffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+void to_lower_case(char *str) {
+    for (int i = 0; str[i]; i++) {
+        str[i] = tolower(str[i]);
     }
-    pos += sprintf(report + pos, "Clinical Rating: %.1f/5.0\n", c->clinical_rating);
-    
-    pos += sprintf(report + pos, "\nTHERAPY GOALS:\n");
-    for (int i = 0; i < c->goal_count; i++) {
-        pos += sprintf(report + pos, "%d. %s\n   Target: %d sessions, Achieved: %d, Status: %s\n", 
-                      c->goals[i].id, c->goals[i].description,
-                      c->goals[i].target_sessions, c->goals[i].achieved,
-                      c->goals[i].status);
+}
+
+// Day number arithmetic works in 400-year eras starting on March 1st, so
+// the leap day falls at the end of each year.
+Date date_from_ymd(int year, int month, int day) {
+    year -= month <= 2;
+    int era = year / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy;
+}
+
+void date_to_ymd(Date date, int *year, int *month, int *day) {
+    int era = date / 146097;
+    int doe = date - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+static int days_in_month(int year, int month) {
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : days[month - 1];
+}
+
+// Accepts exactly "YYYY-MM-DD" naming a real calendar day.
+bool parse_date(const char *text, Date *date) {
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7 ? text[i] != '-' : !isdigit((unsigned char)text[i])) return false;
     }
+    if (text[10] != '\0') return false;
     
-    pos += sprintf(report + pos, "\nTOTAL SESSIONS COMPLETED: %d\n", c->session_count);
-    
-    pos += sprintf(report + pos, "\nRECENT SESSIONS:\n");
-    int start = (c->session_count > 5) ? c->session_count - 5 : 0;
-    for (int i = start; i < c->session_count; i++) {
-        pos += sprintf(report + pos, "\nSession %d on %s\n", 
-                      c->sessions[i].session_id, c->sessions[i].date);
-        pos += sprintf(report + pos, "Activities: %s\n", c->sessions[i].activities);
-        pos += sprintf(report + pos, "Observations: %s\n", c->sessions[i].observations);
-        if (strlen(c->sessions[i].supervisor_feedback) > 0) {
-            pos += sprintf(report + pos, "Supervisor Feedback: %s\n", 
-                          c->sessions[i].supervisor_feedback);
+    int year = (text[0] - '0') * 1000 + (text[1] - '0') * 100 + (text[2] - '0') * 10 + (text[3] - '0');
+    int month = (text[5] - '0') * 10 + (text[6] - '0');
+    int day = (text[8] - '0') * 10 + (text[9] - '0');
+    if (year < 1 || month < 1 || month > 12 || day < 1 || day > days_in_month(year, month)) return false;
+    *date = date_from_ymd(year, month, day);
+    return true;
+}
+
+// Formats as "YYYY-MM-DD", or "" for NO_DATE. The result is meant to be
+// used directly in a printf argument list.
+DateText date_text(Date date) {
+    DateText out = { "" };
+    if (date == NO_DATE) return out;
+    int year, month, day;
+    date_to_ymd(date, &year, &month, &day);
+    out.text[0] = '0' + year / 1000 % 10;
+    out.text[1] = '0' + year / 100 % 10;
+    out.text[2] = '0' + year / 10 % 10;
+    out.text[3] = '0' + year % 10;
+    out.text[4] = '-';
+    out.text[5] = '0' + month / 10;
+    out.text[6] = '0' + month % 10;
+    out.text[7] = '-';
+    out.text[8] = '0' + day / 10;
+    out.text[9] = '0' + day % 10;
+    out.text[10] = '\0';
+    return out;
+}
+
+// Reads a date from a fixed-size string field of the older file formats.
+Date date_from_field(const char field[11]) {
+    char text[11];
+    memcpy(text, field, 10);
+    text[10] = '\0';
+    Date date;
+    return parse_date(text, &date) ? date : NO_DATE;
+}
+
+// Accepts a case status name in any letter case.
+bool parse_case_status(const char *text, int *status) {
+    for (int i = CASE_ACTIVE; i < CASE_STATUS_COUNT; i++) {
+        if (strcasecmp(text, case_status_names[i]) == 0) {
+            *status = i;
+            return true;
         }
     }
-    
-    printf("%s", report);
-    
-    if (export_to_file) {
-        char filename[50];
-        sprintf(filename, "Case_%d_Report.txt", c->id);
-        
-        FILE *file = fopen(filename, "w");
-        if (file) {
-            fputs(report, file);
-            fclose(file);
-            printf("\nReport saved to %s\n", filename);
-        } else {
-            printf("\nError saving report to file.\n");
-        }
+    return false;
+}
+
+// Like parse_case_status, but "any" gives 0, which matches every case.
+bool parse_status_filter(const char *text, int *status) {
+    if (strcasecmp(text, "any") == 0) {
+        *status = 0;
+        return true;
     }
+    return parse_case_status(text, status);
 }
 
-void evaluate_case(int case_index) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
+void print_status_choices() {
+    printf("Unknown status. Use one of:");
+    for (int i = CASE_ACTIVE; i < CASE_STATUS_COUNT; i++) printf(" %s", case_status_names[i]);
+    printf("\n");
+}
+
+// Maps the free-text status of the older file formats. Anything
+// unrecognised on a closed case becomes CASE_CLOSED.
+int case_status_from_field(const char field[20], bool active) {
+    char text[20];
+    memcpy(text, field, 19);
+    text[19] = '\0';
+    int status;
+    if (active) return CASE_ACTIVE;
+    return parse_case_status(text, &status) && status != CASE_ACTIVE ? status : CASE_CLOSED;
+}
+
+int goal_status_from_field(const char field[20], int achieved, int target) {
+    char text[20];
+    memcpy(text, field, 19);
+    text[19] = '\0';
+    for (int i = GOAL_NOT_STARTED; i < GOAL_STATUS_COUNT; i++) {
+        if (strcasecmp(text, goal_status_names[i]) == 0) return i;
     }
-    
-    TherapyCase *c = &cases[case_index];
-    print_menu_header("Case Evaluation");
-    
-    if (c->session_count < 10) {
-        printf("Evaluation requires at least 10 sessions. Current sessions: %d\n", 
-               c->session_count);
-        return;
+    return achieved == 0 ? GOAL_NOT_STARTED : achieved >= target ? GOAL_COMPLETED : GOAL_IN_PROGRESS;
+}
+
+// localtime() is only consulted again once the cached day has ended.
+Date date_today() {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static Date today = NO_DATE;
+    static time_t expires = 0;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&lock);
+    if (now >= expires) {
+        struct tm tm = *localtime(&now);
+        today = date_from_ymd(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+        tm.tm_mday++;
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        expires = mktime(&tm);
     }
-    
-    printf("Enter supervisor feedback for the case:\n");
-    clear_input_buffer();
-    fgets(c->sessions[c->session_count-1].supervisor_feedback, 
-         sizeof(c->sessions[c->session_count-1].supervisor_feedback), stdin);
-    c->sessions[c->session_count-1].supervisor_feedback[strcspn(
-        c->sessions[c->session_count-1].supervisor_feedback, "\n")] = '\0';
-    c->sessions[c->session_count-1].supervisor_reviewed = true;
-    
-    printf("Enter clinical rating (0.0 - 5.0): ");
-    scanf("%f", &c->clinical_rating);
-    
-    printf("\nCase evaluation completed successfully.\n");
+    Date result = today;
+    pthread_mutex_unlock(&lock);
+    return result;
 }
 
-void view_case_details(int case_index) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
+// Prompts until a valid date is entered.
+Date read_date() {
+    char text[11];
+    Date date;
+    scanf("%10s", text);
+    while (!parse_date(text, &date)) {
+        printf("Invalid date. Please use YYYY-MM-DD: ");
+        scanf("%10s", text);
     }
+    return date;
+}
+
+void print_menu_header(const char *title) {
+    printf("\n================================\n");
+    printf("%s\n", title);
+    printf("================================\n");
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--caseload-limit <n>] [--batch <file>|-]\n", program);
+    fprintf(stderr, "       %s --export-reports [--archive <file>] [--supervisor <id>] [--therapist <id>]\n"
+                    "           [--status <status>] [--from <YYYY-MM-DD>] [--to <YYYY-MM-DD>]\n", program);
+    fprintf(stderr, "       %s --search <query>\n", program);
+    fprintf(stderr, "       %s --analytics [--supervisor <id>]\n", program);
+    fprintf(stderr, "       %s --serve [<socket path>]\n", program);
+    fprintf(stderr, "       %s --loadgen [<socket path>] [--idle <n>] [--requests <n>] [--clients <n>]\n"
+                    "                 [--writes <percent>] [--cases <n>]\n", program);
+    fprintf(stderr, "       %s --stress-sessions [--clients <writers>] [--requests <appends>] [--cases <n>]\n", program);
+    fprintf(stderr, "       %s --generate <cases> [clinic options]\n", program);
+    fprintf(stderr, "       %s --bench [--sizes <n,n,...>] [--json <file>] [clinic options]\n", program);
+    fprintf(stderr, "  clinic options: [--therapists <n>] [--supervisors <n>] [--goals-per-case <n>]\n"
+                    "                  [--sessions-per-case <n>] [--note-words <n>] [--seed <n>]\n");
+    fprintf(stderr, "       %s --sessions [--from <YYYY-MM-DD>] [--to <YYYY-MM-DD>] [--supervisor <id>] [--therapist <id>]\n", program);
+    fprintf(stderr, "  any mode: [--metrics text|json] prints timings and counters to stderr on exit\n");
+}
+
+int main(int argc, char **argv) {
+    const char *batch_path = NULL;
+    bool export_mode = false;
+    const char *archive_path = NULL;
+    const char *search_query = NULL;
+    bool analytics_mode = false;
+    bool sessions_mode = false;
+    const char *serve_path = NULL;
+    const char *loadgen_path = NULL;
+    bool stress_mode = false;
+    const char *metrics_format = NULL;
+    int generate_cases = 0;
+    bool bench_mode = false;
+    const char *bench_sizes = "1000,100000,1000000";
+    const char *bench_json = NULL;
+    ClinicConfig clinic = { 0, 0, 0, 3, 6, 12, 0 };
+    int load_idle = 10000;
+    long load_requests = 100000;
+    int load_clients = 8;
+    int load_writes = 0;
+    int load_cases = 1;
+    ExportFilter filter = { { 0 } };
     
-    TherapyCase *c = &cases[case_index];
-    print_menu_header("Case Details");
-    
-    printf("Case ID: %d\n", c->id);
-    printf("Patient ID: %d\n", c->patient_id);
-    printf("Therapist ID: %d\n", c->therapist_id);
-    printf("Supervisor ID: %d\n", c->supervisor_id);
-    printf("Status: %s\n", c->status);
-    printf("Start Date: %s\n", c->start_date);
-    if (strlen(c->end_date) > 0) printf("End Date: %s\n", c->end_date);
-    printf("Goals: %d\n", c->goal_count);
-    printf("Sessions: %d\n", c->session_count);
-    printf("Clinical Rating: %.1f/5.0\n", c->clinical_rating);
-    
-    if (c->session_count > 0) {
-        printf("Last Session: %s\n", c->sessions[c->session_count-1].date);
-        if (c->sessions[c->session_count-1].supervisor_reviewed) {
-            printf("Last Supervisor Review: Completed\n");
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--batch") == 0 && has_value) {
+            batch_path = argv[++i];
+        } else if (strcmp(argv[i], "--export-reports") == 0) {
+            export_mode = true;
+        } else if (strcmp(argv[i], "--archive") == 0 && has_value) {
+            archive_path = argv[++i];
+        } else if (strcmp(argv[i], "--supervisor") == 0 && has_value) {
+            filter.query.supervisor_id = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--therapist") == 0 && has_value) {
+            filter.query.therapist_id = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--status") == 0 && has_value && parse_status_filter(argv[i + 1], &filter.query.status)) {
+            i++;
+        } else if (strcmp(argv[i], "--from") == 0 && has_value && parse_date(argv[i + 1], &filter.from)) {
+            i++;
+        } else if (strcmp(argv[i], "--to") == 0 && has_value && parse_date(argv[i + 1], &filter.to)) {
+            i++;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serve_path = has_value && argv[i + 1][0] != '-' ? argv[++i] : SERVER_SOCKET;
+        } else if (strcmp(argv[i], "--loadgen") == 0) {
+            loadgen_path = has_value && argv[i + 1][0] != '-' ? argv[++i] : SERVER_SOCKET;
+        } else if (strcmp(argv[i], "--generate") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            generate_cases = clinic.cases = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench_mode = true;
+        } else if (strcmp(argv[i], "--sizes") == 0 && has_value) {
+            bench_sizes = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && has_value) {
+            bench_json = argv[++i];
+        } else if (strcmp(argv[i], "--therapists") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            clinic.therapists = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--supervisors") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            clinic.supervisors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--goals-per-case") == 0 && has_value && atoi(argv[i + 1]) >= 0) {
+            clinic.goals_per_case = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sessions-per-case") == 0 && has_value && atoi(argv[i + 1]) >= 0) {
+            clinic.sessions_per_case = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--note-words") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            clinic.note_words = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            clinic.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--metrics") == 0 && has_value &&
+                   (strcmp(argv[i + 1], "text") == 0 || strcmp(argv[i + 1], "json") == 0)) {
+            metrics_format = argv[++i];
+        } else if (strcmp(argv[i], "--stress-sessions") == 0) {
+            stress_mode = true;
+        } else if (strcmp(argv[i], "--idle") == 0 && has_value && atoi(argv[i + 1]) >= 0) {
+            load_idle = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--requests") == 0 && has_value && atol(argv[i + 1]) >= 0) {
+            load_requests = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--clients") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            load_clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--writes") == 0 && has_value && atoi(argv[i + 1]) >= 0 && atoi(argv[i + 1]) <= 100) {
+            load_writes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cases") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            load_cases = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sessions") == 0) {
+            sessions_mode = true;
+        } else if (strcmp(argv[i], "--analytics") == 0) {
+            analytics_mode = true;
+        } else if (strcmp(argv[i], "--search") == 0 && has_value) {
+            search_query = argv[++i];
+        } else if (strcmp(argv[i], "--caseload-limit") == 0 && has_value && atoi(argv[i + 1]) > 0) {
+            caseload_limit = atoi(argv[++i]);
         } else {
-            printf("Last Supervisor Review: Pending\n");
+            usage(argv[0]);
+            return 2;
         }
     }
-}
-
-void search_cases() {
-    print_menu_header("Search Cases");
+    if ((batch_path != NULL) + export_mode + analytics_mode + sessions_mode + (search_query != NULL) + (serve_path != NULL) + (loadgen_path != NULL) + stress_mode + (generate_cases > 0) + bench_mode > 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (metrics_format != NULL) {
+        metrics_at_exit_json = strcmp(metrics_format, "json") == 0;
+        atexit(metrics_dump_at_exit);
+    }
+    if (loadgen_path != NULL) {
+        return run_loadgen(loadgen_path, load_idle, load_requests, load_clients, load_writes, load_cases);
+    }
+    if (stress_mode) {
+        return run_session_stress(load_clients, load_requests, load_cases);
+    }
+    if (generate_cases > 0) {
+        return run_generate(&clinic);
+    }
+    if (bench_mode) {
+        return run_bench(&clinic, bench_sizes, bench_json);
+    }
     
-    printf("Search by:\n");
-    printf("1. Patient ID\n");
-    printf("2. Therapist ID\n");
-    printf("3. Supervisor ID\n");
-    printf("4. Status\n");
-    printf("5. Show All\n");
-    printf("Choice: ");
+    load_data();
+    if (therapist_count == 0) {
+        therapist_count = 3;
+        pool_reserve(&therapist_pool, therapist_count);
+        strcpy(therapist_at(0)->name, "John Smith"); 
+        therapist_at(0)->id = 1;
+        strcpy(therapist_at(0)->specialization, "Child Speech Disorders");
+        strcpy(therapist_at(0)->email, "john.smith@therapy.com");
+        
+        strcpy(therapist_at(1)->name, "Emily Davis"); 
+        therapist_at(1)->id = 2;
+        strcpy(therapist_at(1)->specialization, "Aphasia Rehabilitation");
+        strcpy(therapist_at(1)->email, "emily.davis@therapy.com");
+        
+        strcpy(therapist_at(2)->name, "Michael Johnson"); 
+        therapist_at(2)->id = 3;
+        strcpy(therapist_at(2)->specialization, "Voice Disorders");
+        strcpy(therapist_at(2)->email, "michael.johnson@therapy.com");
+    }
     
-    int choice;
-    scanf("%d", &choice);
+    if (supervisor_count == 0) {
+        supervisor_count = 2;
+        pool_reserve(&supervisor_pool, supervisor_count);
+        strcpy(supervisor_at(0)->name, "Dr. Sarah Wilson"); 
+        supervisor_at(0)->id = 1;
+        strcpy(supervisor_at(0)->email, "sarah.wilson@therapy.com");
+        
+        strcpy(supervisor_at(1)->name, "Dr. Robert Brown"); 
+        supervisor_at(1)->id = 2;
+        strcpy(supervisor_at(1)->email, "robert.brown@therapy.com");
+    }
+    rebuild_indexes();
+    wal_recover();
+    wal_open();
+    if (data_needs_migration) {
+        wal_checkpoint();
+    }
+    
+    if (batch_path != NULL) {
+        return run_batch(batch_path);
+    }
+    if (serve_path != NULL) {
+        return run_server(serve_path);
+    }
+    if (analytics_mode) {
+        print_analytics(filter.query.supervisor_id);
+        return 0;
+    }
+    if (sessions_mode) {
+        SessionFilter sessions = { filter.query.therapist_id, filter.query.supervisor_id, false, 0 };
+        print_sessions_in_range(&sessions, filter.from, filter.to);
+        return 0;
+    }
+    if (search_query != NULL) {
+        int matches = text_search(search_query, print_text_hit, NULL);
+        printf("%d matching entr%s.\n", matches, matches == 1 ? "y" : "ies");
+        return 0;
+    }
+    if (export_mode) {
+        int written = export_reports(&filter, archive_path);
+        if (written < 0) {
+            fprintf(stderr, "Error writing reports.\n");
+            return 1;
+        }
+        printf("%d report(s) written%s%s\n", written,
+               archive_path ? " to " : ".", archive_path ? archive_path : "");
+        return 0;
+    }
     
+    int choice;
     int id;
-    char status[20];
     
-    printf("\nSearch Results:\n");
-    printf("ID\tPatient\tTherapist\tSessions\tStatus\n");
-    printf("------------------------------------------------\n");
+    print_menu_header("Speech Language Therapy Clinical Services Software");
     
-    for (int i = 0; i < case_count; i++) {
-        TherapyCase *c = &cases[i];
-        bool match = false;
+    while(1) {
+        printf("\nMain Menu:\n");
+        printf("1. Staff Login\n");
+        printf("2. Allocate New Case\n");
+        printf("3. Create/Modify Therapy Plan\n");
+        printf("4. Record Therapy Session\n");
+        printf("5. Generate Progress Report\n");
+        printf("6. Evaluate Case\n");
+        printf("7. View Case Details\n");
+        printf("8. List/Search Cases\n");
+        printf("9. Close Case\n");
+        printf("10. Save & Exit\n");
+        wal_sync();
+        printf("Enter your choice: ");
+        
+        if (scanf("%d", &choice) != 1) {
+            printf("Invalid input. Please enter a number.\n");
+            clear_input_buffer();
+            continue;
+        }
         
         switch(choice) {
             case 1:
-                printf("Enter Patient ID: ");
+                printf("Enter your ID (1-%d for therapists, %d+ for supervisors): ", 
+                      therapist_count, therapist_count+1);
                 scanf("%d", &id);
-                match = (c->patient_id == id);
+                if (id <= therapist_count) {
+                    therapist_dashboard(id);
+                } else if (id <= therapist_count + supervisor_count) {
+                    supervisor_dashboard(supervisor_at(id - therapist_count - 1)->id);
+                } else {
+                    printf("Invalid ID.\n");
+                }
                 break;
             case 2:
-                printf("Enter Therapist ID: ");
-                scanf("%d", &id);
-                match = (c->therapist_id == id);
+                printf("Auto-allocate therapist? (1=Yes, 0=No): ");
+                int auto_s;
+                scanf("%d", &auto_s);
+                allocate_case(auto_s);
                 break;
             case 3:
-                printf("Enter Supervisor ID: ");
+                printf("Enter case index: ");
                 scanf("%d", &id);
-                match = (c->supervisor_id == id);
+                create_therapy_plan(id);
                 break;
             case 4:
-                printf("Enter Status: ");
-                scanf("%19s", status);
-                to_lower_case(status);
-                char case_status[20];
-                strcpy(case_status, c->status);
-                to_lower_case(case_status);
-                match = (strcmp(case_status, status) == 0);
+                printf("Enter case index: ");
+                scanf("%d", &id);
+                record_session(id);
                 break;
             case 5:
-                match = true;
+                printf("Enter case index: ");
+                scanf("%d", &id);
+                printf("Export to file? (1=Yes, 0=No): ");
+                int export;
+                scanf("%d", &export);
+                generate_progress_report(id, export);
                 break;
-            default:
+            case 6:
+                printf("Enter case index: ");
+                scanf("%d", &id);
+                evaluate_case(id);
+                break;
+            case 7:
+                printf("Enter case index: ");
+                scanf("%d", &id);
+                view_case_details(id);
+                break;
+            case 8:
+                search_cases();
+                break;
+            case 9:
+                printf("Enter case index to close: ");
+                scanf("%d", &id);
+                close_case(id);
+                break;
+            case 10:
+                wal_checkpoint();
+                printf("Data saved. Exiting...\n");
+                exit(0);
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    }
+    
+    return 0;
+}
+
+// Layout of the original raw-struct data file, kept so that existing
+// therapy_data.dat files can still be loaded and migrated.
+#define LEGACY_MAX_SESSIONS 50
+
+typedef struct {
+    int id;
+    char name[100];
+    char diagnosis[200];
+    int age;
+    char gender;
+    char contact[15];
+    char admission_date[11];
+} LegacyPatient;
+
+typedef struct {
+    int id;
+    char description[200];
+    int target_sessions;
+    int achieved;
+    char status[20];
+} LegacyTherapyGoal;
+
+typedef struct {
+    int session_id;
+    int patient_id;
+    int therapist_id;
+    char date[11];
+    char activities[500];
+    char observations[500];
+    char supervisor_feedback[500];
+    bool supervisor_reviewed;
+} LegacyTherapySession;
+
+typedef struct {
+    int id;
+    int patient_id;
+    int therapist_id;
+    int supervisor_id;
+    LegacyTherapyGoal goals[MAX_GOALS];
+    int goal_count;
+    LegacyTherapySession sessions[LEGACY_MAX_SESSIONS];
+    int session_count;
+    bool is_active;
+    float clinical_rating;
+    char start_date[11];
+    char end_date[11];
+    char status[20];
+} LegacyTherapyCase;
+
+bool load_legacy_data(FILE *file) {
+    if (fread(&patient_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&therapist_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&supervisor_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&case_count, sizeof(int), 1, file) != 1) return false;
+    if (patient_count < 0 || therapist_count < 0 || supervisor_count < 0 || case_count < 0) return false;
+    
+    pool_reserve(&patient_pool, patient_count);
+    for (int i = 0; i < patient_count; i++) {
+        LegacyPatient old;
+        if (fread(&old, sizeof(old), 1, file) != 1) return false;
+        Patient *p = patient_at(i);
+        p->id = old.id;
+        memcpy(p->name, old.name, sizeof(p->name));
+        old.diagnosis[sizeof(old.diagnosis) - 1] = '\0';
+        p->diagnosis = str_put(old.diagnosis);
+        p->age = old.age;
+        p->gender = old.gender;
+        memcpy(p->contact, old.contact, sizeof(p->contact));
+        p->admission_date = date_from_field(old.admission_date);
+    }
+    
+    if (pool_read(&therapist_pool, file, therapist_count) != therapist_count) return false;
+    if (pool_read(&supervisor_pool, file, supervisor_count) != supervisor_count) return false;
+    
+    LegacyTherapyCase *old = malloc(sizeof(LegacyTherapyCase));
+    if (old == NULL) return false;
+    pool_reserve(&case_pool, case_count);
+    pool_reserve(&case_goal_pool, case_count);
+    for (int i = 0; i < case_count; i++) {
+        if (fread(old, sizeof(*old), 1, file) != 1) {
+            free(old);
+            return false;
+        }
+        TherapyCase *c = case_at(i);
+        c->id = old->id;
+        c->patient_id = old->patient_id;
+        c->therapist_id = old->therapist_id;
+        c->supervisor_id = old->supervisor_id;
+        c->goal_count = old->goal_count;
+        for (int j = 0; j < old->goal_count && j < MAX_GOALS; j++) {
+            TherapyGoal *g = &case_goals(i)[j];
+            old->goals[j].description[sizeof(old->goals[j].description) - 1] = '\0';
+            g->id = old->goals[j].id;
+            g->description = str_put(old->goals[j].description);
+            g->target_sessions = old->goals[j].target_sessions;
+            g->achieved = old->goals[j].achieved;
+            g->status = goal_status_from_field(old->goals[j].status, g->achieved, g->target_sessions);
+        }
+        c->first_session = c->last_session = NO_SESSION;
+        c->session_count = 0;
+        for (int j = 0; j < old->session_count && j < LEGACY_MAX_SESSIONS; j++) {
+            LegacyTherapySession *os = &old->sessions[j];
+            int index = session_new(c);
+            TherapySession *s = session_at(index);
+            s->session_id = os->session_id;
+            s->patient_id = os->patient_id;
+            s->therapist_id = os->therapist_id;
+            s->date = date_from_field(os->date);
+            os->activities[sizeof(os->activities) - 1] = '\0';
+            os->observations[sizeof(os->observations) - 1] = '\0';
+            os->supervisor_feedback[sizeof(os->supervisor_feedback) - 1] = '\0';
+            s->activities = str_put(os->activities);
+            s->observations = str_put(os->observations);
+            s->supervisor_feedback = str_put(os->supervisor_feedback);
+            s->supervisor_reviewed = os->supervisor_reviewed;
+            session_link(c, index);
+        }
+        c->is_active = old->is_active;
+        c->clinical_rating = old->clinical_rating;
+        c->start_date = date_from_field(old->start_date);
+        c->end_date = date_from_field(old->end_date);
+        c->status = case_status_from_field(old->status, c->is_active);
+    }
+    free(old);
+    
+    printf("Migrated %d cases from the old data file format.\n", case_count);
+    return true;
+}
+
+// Record layouts of snapshot version 1 and the stream formats, which kept
+// dates as "YYYY-MM-DD" strings. Such files are converted on load.
+// Versions up to 3 also kept statuses as free text.
+typedef struct {
+    int id;
+    StrRef description;
+    int target_sessions;
+    int achieved;
+    char status[20];
+} TherapyGoalV3;
+
+typedef struct {
+    TherapyGoalV3 goals[MAX_GOALS];
+} CaseGoalsV3;
+
+typedef struct {
+    int id;
+    char name[100];
+    StrRef diagnosis;
+    int age;
+    char gender;
+    char contact[15];
+    char admission_date[11];
+} PatientV1;
+
+typedef struct {
+    int session_id;
+    int case_id;
+    int patient_id;
+    int therapist_id;
+    char date[11];
+    StrRef activities;
+    StrRef observations;
+    StrRef supervisor_feedback;
+    bool supervisor_reviewed;
+    int next_in_case;
+} TherapySessionV1;
+
+typedef struct {
+    int id;
+    int patient_id;
+    int therapist_id;
+    int supervisor_id;
+    TherapyGoalV3 goals[MAX_GOALS];
+    int goal_count;
+    int first_session;
+    int last_session;
+    int session_count;
+    bool is_active;
+    float clinical_rating;
+    char start_date[11];
+    char end_date[11];
+    char status[20];
+} TherapyCaseV1;
+
+// Case layout of snapshot version 2, before goals moved to their own store.
+typedef struct {
+    int id;
+    int patient_id;
+    int therapist_id;
+    int supervisor_id;
+    TherapyGoalV3 goals[MAX_GOALS];
+    int goal_count;
+    int first_session;
+    int last_session;
+    int session_count;
+    bool is_active;
+    float clinical_rating;
+    Date start_date;
+    Date end_date;
+    char status[20];
+} TherapyCaseV2;
+
+// Case header layout of snapshot version 3.
+typedef struct {
+    int id;
+    int patient_id;
+    int therapist_id;
+    int supervisor_id;
+    int session_count;
+    int goal_count;
+    int first_session;
+    int last_session;
+    float clinical_rating;
+    Date start_date;
+    Date end_date;
+    bool is_active;
+    char status[20];
+} TherapyCaseV3;
+
+void upgrade_goals(int slot, const TherapyGoalV3 *old) {
+    TherapyGoal *g = case_goals(slot);
+    for (int j = 0; j < MAX_GOALS; j++) {
+        g[j].id = old[j].id;
+        g[j].description = old[j].description;
+        g[j].target_sessions = old[j].target_sessions;
+        g[j].achieved = old[j].achieved;
+        g[j].status = goal_status_from_field(old[j].status, old[j].achieved, old[j].target_sessions);
+    }
+}
+
+void upgrade_v2_cases(Pool *cases) {
+    pool_reserve(&case_pool, case_count);
+    pool_reserve(&case_goal_pool, case_count);
+    for (int i = 0; i < case_count; i++) {
+        const TherapyCaseV2 *old = pool_at(cases, i);
+        TherapyCase *c = case_at(i);
+        c->id = old->id;
+        c->patient_id = old->patient_id;
+        c->therapist_id = old->therapist_id;
+        c->supervisor_id = old->supervisor_id;
+        c->session_count = old->session_count;
+        c->goal_count = old->goal_count;
+        c->first_session = old->first_session;
+        c->last_session = old->last_session;
+        c->clinical_rating = old->clinical_rating;
+        c->start_date = old->start_date;
+        c->end_date = old->end_date;
+        c->is_active = old->is_active;
+        c->status = case_status_from_field(old->status, old->is_active);
+        upgrade_goals(i, old->goals);
+    }
+}
+
+void upgrade_v3_cases(Pool *cases, Pool *goals) {
+    pool_reserve(&case_pool, case_count);
+    pool_reserve(&case_goal_pool, case_count);
+    for (int i = 0; i < case_count; i++) {
+        const TherapyCaseV3 *old = pool_at(cases, i);
+        TherapyCase *c = case_at(i);
+        c->id = old->id;
+        c->patient_id = old->patient_id;
+        c->therapist_id = old->therapist_id;
+        c->supervisor_id = old->supervisor_id;
+        c->session_count = old->session_count;
+        c->goal_count = old->goal_count;
+        c->first_session = old->first_session;
+        c->last_session = old->last_session;
+        c->clinical_rating = old->clinical_rating;
+        c->start_date = old->start_date;
+        c->end_date = old->end_date;
+        c->is_active = old->is_active;
+        c->status = case_status_from_field(old->status, old->is_active);
+        upgrade_goals(i, ((const CaseGoalsV3 *)pool_at(goals, i))->goals);
+    }
+}
+
+void upgrade_v1_records(Pool *patients, Pool *cases, Pool *sessions) {
+    pool_reserve(&patient_pool, patient_count);
+    for (int i = 0; i < patient_count; i++) {
+        const PatientV1 *old = pool_at(patients, i);
+        Patient *p = patient_at(i);
+        p->id = old->id;
+        memcpy(p->name, old->name, sizeof(p->name));
+        p->diagnosis = old->diagnosis;
+        p->age = old->age;
+        p->gender = old->gender;
+        memcpy(p->contact, old->contact, sizeof(p->contact));
+        p->admission_date = date_from_field(old->admission_date);
+    }
+    
+    pool_reserve(&case_pool, case_count);
+    pool_reserve(&case_goal_pool, case_count);
+    for (int i = 0; i < case_count; i++) {
+        const TherapyCaseV1 *old = pool_at(cases, i);
+        TherapyCase *c = case_at(i);
+        c->id = old->id;
+        c->patient_id = old->patient_id;
+        c->therapist_id = old->therapist_id;
+        c->supervisor_id = old->supervisor_id;
+        upgrade_goals(i, old->goals);
+        c->goal_count = old->goal_count;
+        c->first_session = old->first_session;
+        c->last_session = old->last_session;
+        c->session_count = old->session_count;
+        c->is_active = old->is_active;
+        c->clinical_rating = old->clinical_rating;
+        c->start_date = date_from_field(old->start_date);
+        c->end_date = date_from_field(old->end_date);
+        c->status = case_status_from_field(old->status, old->is_active);
+    }
+    
+    pool_reserve(&session_pool, session_log_count);
+    for (int i = 0; i < session_log_count; i++) {
+        const TherapySessionV1 *old = pool_at(sessions, i);
+        TherapySession *s = session_at(i);
+        s->session_id = old->session_id;
+        s->case_id = old->case_id;
+        s->patient_id = old->patient_id;
+        s->therapist_id = old->therapist_id;
+        s->date = date_from_field(old->date);
+        s->activities = old->activities;
+        s->observations = old->observations;
+        s->supervisor_feedback = old->supervisor_feedback;
+        s->supervisor_reviewed = old->supervisor_reviewed;
+        s->next_in_case = old->next_in_case;
+    }
+}
+
+bool load_stream_data(FILE *file, int magic) {
+    if (magic == DATA_MAGIC) {
+        if (fread(&wal.checkpoint_lsn, sizeof(uint64_t), 1, file) != 1) return false;
+    }
+    
+    int heap_chunks;
+    uint32_t heap_used;
+    if (fread(&patient_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&therapist_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&supervisor_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&case_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&session_log_count, sizeof(int), 1, file) != 1) return false;
+    if (fread(&heap_chunks, sizeof(int), 1, file) != 1) return false;
+    if (fread(&heap_used, sizeof(uint32_t), 1, file) != 1) return false;
+    
+    if (patient_count < 0 || therapist_count < 0 || supervisor_count < 0 || case_count < 0) return false;
+    if (session_log_count < 0 || heap_chunks < 0 || heap_used > STR_CHUNK_BYTES) return false;
+    
+    Pool patients = { sizeof(PatientV1) }, cases = { sizeof(TherapyCaseV1) }, sessions = { sizeof(TherapySessionV1) };
+    bool ok = pool_read(&patients, file, patient_count) == patient_count &&
+              pool_read(&therapist_pool, file, therapist_count) == therapist_count &&
+              pool_read(&supervisor_pool, file, supervisor_count) == supervisor_count &&
+              pool_read(&cases, file, case_count) == case_count &&
+              pool_read(&sessions, file, session_log_count) == session_log_count;
+    if (ok) upgrade_v1_records(&patients, &cases, &sessions);
+    Pool *old[] = { &patients, &cases, &sessions };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < old[i]->chunk_count; j++) free(old[i]->chunks[j]);
+        free(old[i]->chunks);
+    }
+    if (!ok) return false;
+    
+    for (int i = 0; i < heap_chunks; i++) {
+        str_heap_add_chunk();
+        size_t bytes = (i == heap_chunks - 1) ? heap_used : STR_CHUNK_BYTES;
+        if (fread(string_heap.chunks[i], 1, bytes, file) != bytes) return false;
+    }
+    string_heap.used = heap_used;
+    return true;
+}
+
+// Snapshot layout: a header, a section table, then one page-aligned
+// section per store. Full pool and heap chunks are used in place from the
+// mapping; only the partly filled last chunk, which will still be
+// appended to, is copied out. The mapping is private, so later in-memory
+// changes never reach the file.
+typedef enum {
+    SECTION_PATIENTS = 1,
+    SECTION_THERAPISTS,
+    SECTION_SUPERVISORS,
+    SECTION_CASES,
+    SECTION_SESSIONS,
+    SECTION_STRINGS,
+    SECTION_PATIENT_INDEX,
+    SECTION_THERAPIST_INDEX,
+    SECTION_SUPERVISOR_INDEX,
+    SECTION_CASE_INDEX,
+    SECTION_CASE_GOALS,
+    SECTION_TEXT_DICTIONARY,
+    SECTION_COUNT = SECTION_TEXT_DICTIONARY
+} SectionType;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t section_count;
+    uint64_t checkpoint_lsn;
+    uint64_t file_size;
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t elem_size;
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t count;
+    uint32_t chunk_shift;
+    uint32_t aux;
+} SnapshotSection;
+
+static const SnapshotSection *find_section(const SnapshotSection *table, int n, uint32_t type) {
+    for (int i = 0; i < n; i++) {
+        if (table[i].type == type) return &table[i];
+    }
+    return NULL;
+}
+
+bool map_pool(Pool *pool, int *count, char *base, const SnapshotSection *sec) {
+    if (sec == NULL || sec->elem_size != pool->elem_size || sec->count > INT_MAX) return false;
+    if (sec->chunk_shift < POOL_MIN_CHUNK_SHIFT || sec->chunk_shift > 24) return false;
+    
+    if (sec->count * pool->elem_size > sec->bytes) return false;
+    
+    size_t chunk_bytes = ((size_t)1 << sec->chunk_shift) * pool->elem_size;
+    int full = (int)(sec->count >> sec->chunk_shift);
+    
+    pool->chunk_shift = sec->chunk_shift;
+    pool->chunk_count = 0;
+    pool->chunk_capacity = 0;
+    pool->chunks = NULL;
+    pool_reserve(pool, full << sec->chunk_shift);
+    for (int i = 0; i < full; i++) {
+        free(pool->chunks[i]);
+        pool->chunks[i] = base + sec->offset + (size_t)i * chunk_bytes;
+    }
+    
+    size_t tail = (sec->count - ((uint64_t)full << sec->chunk_shift)) * pool->elem_size;
+    if (tail > 0) {
+        pool_reserve(pool, (int)sec->count);
+        memcpy(pool->chunks[full], base + sec->offset + (size_t)full * chunk_bytes, tail);
+    }
+    *count = (int)sec->count;
+    return true;
+}
+
+bool map_index(IdIndex *index, char *base, const SnapshotSection *sec) {
+    if (sec == NULL || sec->count == 0) return sec != NULL;
+    if (sec->elem_size != 2 * sizeof(int) || (sec->count & (sec->count - 1)) != 0) return false;
+    if (sec->count * sec->elem_size > sec->bytes || sec->count > INT_MAX) return false;
+    
+    index->capacity = (int)sec->count;
+    index->size = (int)sec->aux;
+    index->keys = (int *)(base + sec->offset);
+    index->slots = index->keys + index->capacity;
+    index->mapped = true;
+    return true;
+}
+
+// The dictionary section holds a TextDictHeader (since version 6), then
+// each word as a length byte followed by its characters.
+typedef struct {
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t trained_heap_bytes;
+    uint64_t trained_literal_bytes;
+    uint64_t literal_bytes;
+} TextDictHeader;
+
+bool load_text_dictionary(const char *base, const SnapshotSection *sec, uint32_t file_version) {
+    // Files from before the dictionary hold nothing but plain text; version
+    // 5 files were trained when written but kept no counts.
+    text_trained_heap_bytes = sec != NULL ? heap_bytes(&string_heap) : 0;
+    text_literal_bytes = sec != NULL ? 0 : heap_bytes(&string_heap);
+    text_trained_literal_bytes = 0;
+    if (sec == NULL) return true;
+    if (sec->count > TEXT_DICT_MAX) return false;
+    
+    const unsigned char *p = (const unsigned char *)base + sec->offset, *end = p + sec->bytes;
+    uint32_t version = sec->count > 0;
+    if (file_version >= 6) {
+        TextDictHeader h;
+        if (sec->bytes < sizeof(h)) return false;
+        memcpy(&h, p, sizeof(h));
+        p += sizeof(h);
+        version = h.version;
+        text_trained_heap_bytes = h.trained_heap_bytes;
+        text_trained_literal_bytes = h.trained_literal_bytes;
+        text_literal_bytes = h.literal_bytes;
+    }
+    if (sec->count == 0) return true;
+    
+    char *chars = malloc(sec->bytes);
+    uint32_t *offsets = malloc((sec->count + 1) * sizeof(uint32_t));
+    if (chars == NULL || offsets == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    offsets[0] = 0;
+    for (uint64_t i = 0; i < sec->count; i++) {
+        if (p == end || *p == 0 || *p > TEXT_WORD_MAX || *p >= end - p) {
+            free(chars);
+            free(offsets);
+            return false;
+        }
+        memcpy(chars + offsets[i], p + 1, *p);
+        offsets[i + 1] = offsets[i] + *p;
+        p += *p + 1;
+    }
+    text_dict_build(&text_dict, chars, offsets, (uint32_t)sec->count, version);
+    return true;
+}
+
+bool load_snapshot(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) return false;
+    
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return false;
+    madvise(base, st.st_size, MADV_RANDOM);
+    
+    const SnapshotHeader *h = (const SnapshotHeader *)base;
+    if (h->byte_order != SNAPSHOT_BYTE_ORDER) {
+        printf("Data file was written on a machine with a different byte order.\n");
+        goto fail;
+    }
+    if (h->version < 1 || h->version > SNAPSHOT_VERSION) {
+        printf("Unsupported data file version %u.\n", h->version);
+        goto fail;
+    }
+    if (h->file_size != (uint64_t)st.st_size || h->section_count > 64) goto fail;
+    if (sizeof(SnapshotHeader) + h->section_count * sizeof(SnapshotSection) > (size_t)st.st_size) goto fail;
+    
+    const SnapshotSection *table = (const SnapshotSection *)(base + sizeof(SnapshotHeader));
+    int n = h->section_count;
+    for (int i = 0; i < n; i++) {
+        if (table[i].offset % SNAPSHOT_ALIGN != 0) goto fail;
+        if (table[i].offset > h->file_size || table[i].bytes > h->file_size - table[i].offset) goto fail;
+    }
+    
+    // Records of older versions are mapped with their old layout and converted.
+    Pool patients = { sizeof(PatientV1) }, cases = { sizeof(TherapyCaseV1) }, sessions = { sizeof(TherapySessionV1) };
+    Pool goals = { sizeof(CaseGoalsV3) };
+    bool v1 = h->version == 1, v2 = h->version == 2, v3 = h->version == 3;
+    if (v2) cases.elem_size = sizeof(TherapyCaseV2);
+    if (v3) cases.elem_size = sizeof(TherapyCaseV3);
+    if (!map_pool(v1 ? &patients : &patient_pool, &patient_count, base, find_section(table, n, SECTION_PATIENTS))) goto fail;
+    if (!map_pool(&therapist_pool, &therapist_count, base, find_section(table, n, SECTION_THERAPISTS))) goto fail;
+    if (!map_pool(&supervisor_pool, &supervisor_count, base, find_section(table, n, SECTION_SUPERVISORS))) goto fail;
+    if (!map_pool(v1 || v2 || v3 ? &cases : &case_pool, &case_count, base, find_section(table, n, SECTION_CASES))) goto fail;
+    if (!map_pool(v1 ? &sessions : &session_pool, &session_log_count, base, find_section(table, n, SECTION_SESSIONS))) goto fail;
+    if (v1) {
+        upgrade_v1_records(&patients, &cases, &sessions);
+    } else if (v2) {
+        upgrade_v2_cases(&cases);
+    } else {
+        int goal_count;
+        if (!map_pool(v3 ? &goals : &case_goal_pool, &goal_count, base, find_section(table, n, SECTION_CASE_GOALS))) goto fail;
+        if (goal_count != case_count) goto fail;
+        if (v3) upgrade_v3_cases(&cases, &goals);
+    }
+    data_needs_migration = h->version < SNAPSHOT_VERSION;
+    
+    const SnapshotSection *strings = find_section(table, n, SECTION_STRINGS);
+    if (strings == NULL || strings->aux > STR_CHUNK_BYTES || strings->count > INT_MAX) goto fail;
+    if (strings->count > 0 && (strings->count - 1) * STR_CHUNK_BYTES + strings->aux > strings->bytes) goto fail;
+    for (uint64_t i = 0; i < strings->count; i++) {
+        str_heap_add_chunk();
+        char *chunk = base + strings->offset + i * STR_CHUNK_BYTES;
+        if (i + 1 < strings->count) {
+            free(string_heap.chunks[i]);
+            string_heap.chunks[i] = chunk;
+        } else {
+            memcpy(string_heap.chunks[i], chunk, strings->aux);
+        }
+    }
+    string_heap.used = strings->aux;
+    if (!load_text_dictionary(base, find_section(table, n, SECTION_TEXT_DICTIONARY), h->version)) goto fail;
+    
+    if (!map_index(&patient_index, base, find_section(table, n, SECTION_PATIENT_INDEX))) goto fail;
+    if (!map_index(&therapist_index, base, find_section(table, n, SECTION_THERAPIST_INDEX))) goto fail;
+    if (!map_index(&supervisor_index, base, find_section(table, n, SECTION_SUPERVISOR_INDEX))) goto fail;
+    if (!map_index(&case_index, base, find_section(table, n, SECTION_CASE_INDEX))) goto fail;
+    
+    wal.checkpoint_lsn = h->checkpoint_lsn;
+    data_map = base;
+    data_map_size = st.st_size;
+    return true;
+    
+fail:
+    munmap(base, st.st_size);
+    memset(&patient_index, 0, sizeof(IdIndex));
+    memset(&therapist_index, 0, sizeof(IdIndex));
+    memset(&supervisor_index, 0, sizeof(IdIndex));
+    memset(&case_index, 0, sizeof(IdIndex));
+    return false;
+}
+
+void reset_stores() {
+    Pool *pools[] = { &patient_pool, &therapist_pool, &supervisor_pool, &case_pool, &case_goal_pool, &session_pool };
+    for (int i = 0; i < 6; i++) {
+        pools[i]->chunks = NULL;
+        pools[i]->chunk_count = pools[i]->chunk_capacity = 0;
+    }
+    patient_count = therapist_count = supervisor_count = case_count = 0;
+    session_log_count = 0;
+    string_heap.chunks = NULL;
+    string_heap.chunk_count = string_heap.chunk_capacity = 0;
+    string_heap.used = 0;
+    text_dict_free(&text_dict);
+    text_literal_bytes = text_trained_heap_bytes = text_trained_literal_bytes = 0;
+    wal.checkpoint_lsn = 0;
+}
+
+void load_data() {
+    METRIC_SCOPE(OP_LOAD_DATA);
+    int fd = open(FILENAME, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) METRIC_ADD(MC_DATA_BYTES_LOADED, st.st_size);
+    
+    uint32_t magic = 0;
+    bool ok;
+    if (read(fd, &magic, sizeof(magic)) != sizeof(magic)) {
+        ok = false;
+    } else if (magic == SNAPSHOT_MAGIC) {
+        ok = load_snapshot(fd);
+    } else {
+        // Older formats are read into memory and rewritten as a snapshot
+        // at the next checkpoint.
+        FILE *file = fdopen(dup(fd), "rb");
+        ok = file != NULL;
+        if (ok && (magic == DATA_MAGIC || magic == DATA_MAGIC_NO_LSN)) {
+            fseek(file, sizeof(magic), SEEK_SET);
+            ok = load_stream_data(file, magic);
+        } else if (ok) {
+            fseek(file, 0, SEEK_SET);
+            ok = load_legacy_data(file);
+        }
+        if (file != NULL) fclose(file);
+        data_needs_migration = ok;
+        text_literal_bytes = heap_bytes(&string_heap);
+    }
+    close(fd);
+    
+    if (!ok) {
+        printf("Error loading data. Starting with empty database.\n");
+        reset_stores();
+        return;
+    }
+    
+    // Text written without a (good enough) dictionary is compressed now,
+    // and the next checkpoint saves it that way.
+    if (text_retrain_due()) {
+        size_t before, after;
+        uint32_t words = text_store_train(&before, &after);
+        if (words > 0) {
+            printf("Compressed clinical text with a %u-word dictionary (version %u): %.1f MB -> %.1f MB.\n",
+                   words, text_dict.version, before / 1048576.0, after / 1048576.0);
+            data_needs_migration = true;
+        }
+    }
+}
+
+static void write_padding(FILE *file) {
+    static const char zeros[SNAPSHOT_ALIGN];
+    long pos = ftell(file);
+    long pad = (SNAPSHOT_ALIGN - pos % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+    fwrite(zeros, 1, pad, file);
+}
+
+static void begin_section(FILE *file, SnapshotSection *sec, uint32_t type, uint32_t elem_size) {
+    write_padding(file);
+    memset(sec, 0, sizeof(*sec));
+    sec->type = type;
+    sec->elem_size = elem_size;
+    sec->offset = ftell(file);
+}
+
+static void end_section(FILE *file, SnapshotSection *sec) {
+    sec->bytes = ftell(file) - sec->offset;
+}
+
+void write_pool_section(FILE *file, SnapshotSection *sec, uint32_t type, Pool *pool, int count) {
+    pool_reserve(pool, 0);
+    begin_section(file, sec, type, pool->elem_size);
+    pool_write(pool, file, count);
+    sec->count = count;
+    sec->chunk_shift = pool->chunk_shift;
+    end_section(file, sec);
+}
+
+void write_index_section(FILE *file, SnapshotSection *sec, uint32_t type, IdIndex *index) {
+    begin_section(file, sec, type, 2 * sizeof(int));
+    if (index->capacity > 0) {
+        fwrite(index->keys, sizeof(int), index->capacity, file);
+        fwrite(index->slots, sizeof(int), index->capacity, file);
+    }
+    sec->count = index->capacity;
+    sec->aux = index->size;
+    end_section(file, sec);
+}
+
+// Writes a full snapshot next to the data file and renames it into place,
+// so a crash mid-save never leaves a half-written snapshot behind.
+void save_data() {
+    METRIC_SCOPE(OP_SAVE_DATA);
+    FILE *file = fopen(FILENAME ".tmp", "wb");
+    if (file == NULL) {
+        printf("Error saving data!\n");
+        return;
+    }
+    
+    SnapshotHeader h = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, SNAPSHOT_BYTE_ORDER, SECTION_COUNT };
+    h.checkpoint_lsn = wal.next_lsn ? wal.next_lsn - 1 : wal.checkpoint_lsn;
+    SnapshotSection table[SECTION_COUNT];
+    fwrite(&h, sizeof(h), 1, file);
+    fwrite(table, sizeof(table), 1, file);
+    
+    write_pool_section(file, &table[0], SECTION_PATIENTS, &patient_pool, patient_count);
+    write_pool_section(file, &table[1], SECTION_THERAPISTS, &therapist_pool, therapist_count);
+    write_pool_section(file, &table[2], SECTION_SUPERVISORS, &supervisor_pool, supervisor_count);
+    write_pool_section(file, &table[3], SECTION_CASES, &case_pool, case_count);
+    write_pool_section(file, &table[4], SECTION_SESSIONS, &session_pool, session_log_count);
+    
+    begin_section(file, &table[5], SECTION_STRINGS, 1);
+    for (int i = 0; i < string_heap.chunk_count; i++) {
+        size_t bytes = (i == string_heap.chunk_count - 1) ? string_heap.used : STR_CHUNK_BYTES;
+        fwrite(string_heap.chunks[i], 1, bytes, file);
+    }
+    table[5].count = string_heap.chunk_count;
+    table[5].aux = string_heap.used;
+    end_section(file, &table[5]);
+    
+    write_index_section(file, &table[6], SECTION_PATIENT_INDEX, &patient_index);
+    write_index_section(file, &table[7], SECTION_THERAPIST_INDEX, &therapist_index);
+    write_index_section(file, &table[8], SECTION_SUPERVISOR_INDEX, &supervisor_index);
+    write_index_section(file, &table[9], SECTION_CASE_INDEX, &case_index);
+    write_pool_section(file, &table[10], SECTION_CASE_GOALS, &case_goal_pool, case_count);
+    
+    begin_section(file, &table[11], SECTION_TEXT_DICTIONARY, 1);
+    TextDictHeader dict = { text_dict.version, 0, text_trained_heap_bytes, text_trained_literal_bytes, text_literal_bytes };
+    fwrite(&dict, sizeof(dict), 1, file);
+    for (uint32_t i = 0; i < text_dict.count; i++) {
+        unsigned char len = (unsigned char)(text_dict.offsets[i + 1] - text_dict.offsets[i]);
+        fputc(len, file);
+        fwrite(text_dict.chars + text_dict.offsets[i], 1, len, file);
+    }
+    table[11].count = text_dict.count;
+    end_section(file, &table[11]);
+    write_padding(file);
+    
+    h.file_size = ftell(file);
+    METRIC_ADD(MC_DATA_BYTES_SAVED, h.file_size);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, file);
+    fwrite(table, sizeof(table), 1, file);
+    
+    bool ok = !ferror(file) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(FILENAME ".tmp", FILENAME) != 0) {
+        printf("Error saving data!\n");
+        remove(FILENAME ".tmp");
+        return;
+    }
+    wal.checkpoint_lsn = h.checkpoint_lsn;
+    data_needs_migration = false;
+}
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_build() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+// The first checksum may be taken on any server writer thread, so the
+// table is built exactly once and published before any lookup.
+uint32_t crc32(const void *data, size_t len, uint32_t crc) {
+    pthread_once(&crc_table_once, crc_table_build);
+    const unsigned char *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t capacity;
+} ByteBuf;
+
+void buf_reserve(ByteBuf *b, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 4096;
+        while (capacity < b->len + len) capacity *= 2;
+        unsigned char *data = realloc(b->data, capacity);
+        if (data == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        b->data = data;
+        b->capacity = capacity;
+    }
+}
+
+void buf_put(ByteBuf *b, const void *bytes, size_t len) {
+    buf_reserve(b, len);
+    memcpy(b->data + b->len, bytes, len);
+    b->len += len;
+}
+
+void buf_put_int(ByteBuf *b, int value) { buf_put(b, &value, sizeof(value)); }
+
+void buf_put_str(ByteBuf *b, const char *text) {
+    uint32_t len = text ? strlen(text) : 0;
+    if (len > STR_MAX_LEN) len = STR_MAX_LEN;
+    buf_put(b, &len, sizeof(len));
+    buf_put(b, text ? text : "", len);
+    buf_put(b, "", 1);
+}
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    bool ok;
+} ByteReader;
+
+int reader_int(ByteReader *r) {
+    int value = 0;
+    if (r->pos + sizeof(value) > r->len) {
+        r->ok = false;
+        return 0;
+    }
+    memcpy(&value, r->data + r->pos, sizeof(value));
+    r->pos += sizeof(value);
+    return value;
+}
+
+const char *reader_str(ByteReader *r) {
+    uint32_t len;
+    if (r->pos + sizeof(len) > r->len) {
+        r->ok = false;
+        return "";
+    }
+    memcpy(&len, r->data + r->pos, sizeof(len));
+    r->pos += sizeof(len);
+    if (len > r->len - r->pos || r->pos + len >= r->len || r->data[r->pos + len] != '\0') {
+        r->ok = false;
+        return "";
+    }
+    const char *text = (const char *)r->data + r->pos;
+    r->pos += len + 1;
+    return text;
+}
+
+void encode_mutation(ByteBuf *b, const Mutation *m) {
+    buf_put_int(b, m->case_id);
+    buf_put_int(b, m->therapist_id);
+    buf_put_int(b, m->supervisor_id);
+    buf_put_int(b, m->age);
+    buf_put_int(b, m->goal_num);
+    buf_put_int(b, m->target_sessions);
+    buf_put(b, &m->rating, sizeof(m->rating));
+    buf_put(b, &m->gender, 1);
+    buf_put_str(b, date_text(m->date).text);
+    buf_put_str(b, m->name);
+    buf_put_str(b, m->diagnosis);
+    buf_put_str(b, m->contact);
+    buf_put_str(b, m->description);
+    buf_put_str(b, m->activities);
+    buf_put_str(b, m->observations);
+    buf_put_str(b, m->feedback);
+    buf_put_str(b, m->status > 0 && m->status < CASE_STATUS_COUNT ? case_status_names[m->status] : "");
+}
+
+bool decode_mutation(ByteReader *r, int type, Mutation *m) {
+    memset(m, 0, sizeof(*m));
+    m->type = type;
+    m->case_id = reader_int(r);
+    m->therapist_id = reader_int(r);
+    m->supervisor_id = reader_int(r);
+    m->age = reader_int(r);
+    m->goal_num = reader_int(r);
+    m->target_sessions = reader_int(r);
+    if (r->pos + sizeof(m->rating) + 1 > r->len) return false;
+    memcpy(&m->rating, r->data + r->pos, sizeof(m->rating));
+    m->gender = (char)r->data[r->pos + sizeof(m->rating)];
+    r->pos += sizeof(m->rating) + 1;
+    if (!parse_date(reader_str(r), &m->date)) m->date = NO_DATE;
+    m->name = reader_str(r);
+    m->diagnosis = reader_str(r);
+    m->contact = reader_str(r);
+    m->description = reader_str(r);
+    m->activities = reader_str(r);
+    m->observations = reader_str(r);
+    m->feedback = reader_str(r);
+    // Logs written before statuses were validated may hold any text.
+    const char *status = reader_str(r);
+    if (!parse_case_status(status, &m->status)) m->status = *status ? CASE_CLOSED : 0;
+    return r->ok && r->pos == r->len;
+}
+
+static long elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+void wal_open() {
+    wal.file = fopen(WAL_FILENAME, "ab");
+    if (wal.file == NULL) {
+        printf("Warning: cannot open %s; changes will only be saved on exit.\n", WAL_FILENAME);
+        return;
+    }
+    setvbuf(wal.file, NULL, _IOFBF, 1 << 20);
+    fseek(wal.file, 0, SEEK_END);
+    wal.size = ftell(wal.file);
+    if (wal.size == 0) {
+        int magic = WAL_MAGIC;
+        fwrite(&magic, sizeof(int), 1, wal.file);
+        wal.size = sizeof(int);
+    }
+    if (wal.next_lsn <= wal.checkpoint_lsn) wal.next_lsn = wal.checkpoint_lsn + 1;
+    if (wal.group_records == 0) wal.group_records = WAL_GROUP_COMMIT_RECORDS;
+    if (wal.group_ms == 0) wal.group_ms = WAL_GROUP_COMMIT_MS;
+    clock_gettime(CLOCK_MONOTONIC, &wal.last_sync);
+}
+
+// Group commit: records are buffered and made durable together once enough
+// of them are pending or the oldest has waited long enough.
+void wal_sync() {
+    if (wal.file == NULL || wal.pending == 0) return;
+    METRIC_SCOPE(OP_WAL_SYNC);
+    fflush(wal.file);
+    fsync(fileno(wal.file));
+    wal.pending = 0;
+    clock_gettime(CLOCK_MONOTONIC, &wal.last_sync);
+}
+
+// Appends one complete record for m to b.
+void wal_encode_record(ByteBuf *b, const Mutation *m, uint64_t lsn) {
+    const size_t header = sizeof(uint32_t) * 2 + sizeof(uint64_t) + 1;
+    size_t start = b->len;
+    buf_reserve(b, header);
+    b->len += header;
+    encode_mutation(b, m);
+    
+    unsigned char *record = b->data + start;
+    uint32_t len = b->len - start - header;
+    unsigned char type = (unsigned char)m->type;
+    uint32_t crc = crc32(&lsn, sizeof(lsn), 0);
+    crc = crc32(&type, 1, crc);
+    crc = crc32(record + header, len, crc);
+    memcpy(record, &len, sizeof(len));
+    memcpy(record + 4, &crc, sizeof(crc));
+    memcpy(record + 8, &lsn, sizeof(lsn));
+    record[16] = type;
+}
+
+// Buffers the record for m without syncing it. The server's writer uses
+// this directly and syncs once per batch.
+void wal_write(const Mutation *m) {
+    if (wal.file == NULL) return;
+    
+    static ByteBuf record;
+    record.len = 0;
+    wal_encode_record(&record, m, wal.next_lsn++);
+    fwrite(record.data, 1, record.len, wal.file);
+    wal.size += record.len;
+    METRIC_ADD(MC_WAL_BYTES_WRITTEN, record.len);
+    wal.pending++;
+}
+
+void wal_append(const Mutation *m) {
+    if (wal.file == NULL) return;
+    wal_write(m);
+    if (wal.pending >= wal.group_records || elapsed_ms(&wal.last_sync) >= wal.group_ms) {
+        wal_sync();
+    }
+    if (wal.size >= WAL_CHECKPOINT_BYTES) {
+        wal_checkpoint();
+    }
+}
+
+// Compaction: write a snapshot covering everything logged so far, then
+// start a fresh log. Records at or below the snapshot LSN are skipped on
+// recovery, so a crash between the two steps is harmless.
+void wal_checkpoint() {
+    METRIC_SCOPE(OP_CHECKPOINT);
+    wal_sync();
+    // Nobody else holds the store now; free what closed views left.
+    pthread_mutex_lock(&view_lock);
+    view_reclaim();
+    pthread_mutex_unlock(&view_lock);
+    // Open views still see references into the current heap, so the
+    // text is only re-encoded while there are none.
+    if (text_retrain_due() && atomic_load_explicit(&live_views, memory_order_acquire) == 0) {
+        size_t before, after;
+        uint32_t words = text_store_train(&before, &after);
+        if (words > 0) {
+            printf("Retrained the text dictionary (version %u, %u words): %.1f MB -> %.1f MB.\n",
+                   text_dict.version, words, before / 1048576.0, after / 1048576.0);
+        }
+    }
+    save_data();
+    if (wal.checkpoint_lsn + 1 != wal.next_lsn) return;
+    
+    if (wal.file != NULL) fclose(wal.file);
+    FILE *file = fopen(WAL_FILENAME, "wb");
+    if (file != NULL) fclose(file);
+    wal_open();
+}
+
+// Replays the log tail on top of the loaded snapshot. A torn or corrupt
+// record ends recovery; the log is truncated there so that new records
+// are appended after the last good one.
+void wal_recover() {
+    METRIC_SCOPE(OP_WAL_RECOVER);
+    FILE *file = fopen(WAL_FILENAME, "rb");
+    if (file == NULL) return;
+    
+    int magic;
+    long good_end = 0;
+    int replayed = 0;
+    ByteBuf payload = { 0 };
+    wal.next_lsn = wal.checkpoint_lsn + 1;
+    
+    if (fread(&magic, sizeof(int), 1, file) == 1 && magic == WAL_MAGIC) {
+        good_end = sizeof(int);
+        while (1) {
+            uint32_t len, crc;
+            uint64_t lsn;
+            unsigned char type;
+            if (fread(&len, sizeof(len), 1, file) != 1) break;
+            if (fread(&crc, sizeof(crc), 1, file) != 1) break;
+            if (fread(&lsn, sizeof(lsn), 1, file) != 1) break;
+            if (fread(&type, 1, 1, file) != 1) break;
+            if (len > 16 * STR_CHUNK_BYTES) break;
+            
+            payload.len = 0;
+            buf_reserve(&payload, len);
+            if (fread(payload.data, 1, len, file) != len) break;
+            payload.len = len;
+            
+            uint32_t check = crc32(&lsn, sizeof(lsn), 0);
+            check = crc32(&type, 1, check);
+            check = crc32(payload.data, len, check);
+            if (check != crc) break;
+            
+            Mutation m;
+            ByteReader r = { payload.data, len, 0, true };
+            if (!decode_mutation(&r, type, &m)) break;
+            
+            if (lsn > wal.checkpoint_lsn) {
+                apply_mutation(&m);
+                replayed++;
+            }
+            if (lsn >= wal.next_lsn) wal.next_lsn = lsn + 1;
+            good_end = ftell(file);
+        }
+    }
+    fclose(file);
+    free(payload.data);
+    
+    if (truncate(WAL_FILENAME, good_end) != 0) {
+        printf("Warning: could not truncate %s.\n", WAL_FILENAME);
+    }
+    if (replayed > 0) {
+        printf("Recovered %d change(s) from %s.\n", replayed, WAL_FILENAME);
+    }
+}
+
+bool valid_case_slot(int slot) {
+    return slot >= 0 && slot < case_count;
+}
+
+int apply_new_case(const Mutation *m) {
+    if (find_therapist(m->therapist_id) == NULL) return -1;
+    if (find_supervisor(m->supervisor_id) == NULL) return -1;
+    if (m->date == NO_DATE) return -1;
+    
+    pool_reserve(&patient_pool, patient_count + 1);
+    pool_reserve(&case_pool, case_count + 1);
+    pool_reserve(&case_goal_pool, case_count + 1);
+    
+    Patient *p = patient_at(patient_count);
+    memset(p, 0, sizeof(*p));
+    p->id = patient_count + 1;
+    snprintf(p->name, sizeof(p->name), "%s", m->name ? m->name : "");
+    p->diagnosis = str_put(m->diagnosis ? m->diagnosis : "");
+    text_index_add(p->diagnosis, TEXT_OWNER(TEXT_DIAGNOSIS, patient_count));
+    p->age = m->age;
+    p->gender = toupper((unsigned char)m->gender);
+    snprintf(p->contact, sizeof(p->contact), "%s", m->contact ? m->contact : "");
+    p->admission_date = m->date;
+    
+    TherapyCase *c = case_at(case_count);
+    memset(c, 0, sizeof(*c));
+    memset(case_goals(case_count), 0, sizeof(CaseGoals));
+    c->id = case_count + 1;
+    c->patient_id = p->id;
+    c->therapist_id = m->therapist_id;
+    c->supervisor_id = m->supervisor_id;
+    c->goal_count = 0;
+    c->first_session = c->last_session = NO_SESSION;
+    c->session_count = 0;
+    c->is_active = true;
+    c->clinical_rating = 0.0;
+    c->start_date = m->date;
+    c->end_date = NO_DATE;
+    c->status = CASE_ACTIVE;
+    
+    int therapist_slot = id_index_get(&therapist_index, m->therapist_id);
+    therapist_at(therapist_slot)->current_cases++;
+    therapist_load_changed(therapist_slot);
+    id_index_put(&patient_index, p->id, patient_count);
+    id_index_put(&case_index, c->id, case_count);
+    index_case(case_count);
+    
+    patient_count++;
+    return case_count++;
+}
+
+int apply_add_goal(const Mutation *m) {
+    int slot = find_case(m->case_id);
+    if (!valid_case_slot(slot)) return -1;
+    TherapyCase *c = case_for_write(slot);
+    if (c->goal_count >= MAX_GOALS) return -1;
+    
+    TherapyGoal *g = &case_goals_for_write(slot)[c->goal_count];
+    g->id = c->goal_count + 1;
+    g->description = str_put(m->description ? m->description : "");
+    text_index_add(g->description, TEXT_OWNER(TEXT_GOAL, slot * MAX_GOALS + c->goal_count));
+    g->target_sessions = m->target_sessions;
+    g->achieved = 0;
+    g->status = GOAL_NOT_STARTED;
+    c->goal_count++;
+    return slot;
+}
+
+int apply_modify_goal(const Mutation *m) {
+    int slot = find_case(m->case_id);
+    if (!valid_case_slot(slot)) return -1;
+    TherapyCase *c = case_at(slot);
+    if (m->goal_num < 1 || m->goal_num > c->goal_count) return -1;
+    
+    TherapyGoal *g = &case_goals_for_write(slot)[m->goal_num - 1];
+    if (m->description != NULL && strlen(m->description) > 0) {
+        g->description = str_put(m->description);
+        text_index_add(g->description, TEXT_OWNER(TEXT_GOAL, slot * MAX_GOALS + m->goal_num - 1));
+    }
+    if (m->target_sessions > 0) {
+        g->target_sessions = m->target_sessions;
+    }
+    return slot;
+}
+
+int apply_session(const Mutation *m) {
+    int slot = find_case(m->case_id);
+    if (!valid_case_slot(slot)) return -1;
+    TherapyCase *c = case_for_write(slot);
+    if (!c->is_active || m->date == NO_DATE) return -1;
+    
+    int session_idx = session_new(c);
+    TherapySession *s = session_at(session_idx);
+    s->date = m->date;
+    s->activities = str_put(m->activities ? m->activities : "");
+    s->observations = str_put(m->observations ? m->observations : "");
+    
+    if (m->goal_num >= 1 && m->goal_num <= c->goal_count) {
+        pthread_mutex_t *lock = &goal_locks[slot % GOAL_LOCK_STRIPES];
+        pthread_mutex_lock(lock);
+        TherapyGoal *g = &case_goals_for_write(slot)[m->goal_num - 1];
+        g->achieved++;
+        g->status = g->achieved >= g->target_sessions ? GOAL_COMPLETED : GOAL_IN_PROGRESS;
+        pthread_mutex_unlock(lock);
+    }
+    
+    // Indexed once linked, so a hit never shows a session without its number.
+    session_link(c, session_idx);
+    text_index_add(s->activities, TEXT_OWNER(TEXT_ACTIVITIES, session_idx));
+    text_index_add(s->observations, TEXT_OWNER(TEXT_OBSERVATIONS, session_idx));
+    date_index_add(s->date, slot, session_idx);
+    review_update(slot);
+    return slot;
+}
+
+// Applies a session with store_lock held only for reading, beside readers
+// and other appenders. The string heap, goal progress and the text, date
+// and review indexes lock for themselves, and the chain is linked
+// lock-free. While a view is open, the records it can see are copied
+// before they change; appenders then take turns so that no chunk is
+// copied while another appender is writing to it.
+int append_session(const Mutation *m) {
+    METRIC_SCOPE(OP_APPLY_MUTATION);
+    pthread_rwlock_rdlock(&append_lock);
+    // Views open only with append_lock held for writing, so this stays
+    // true or false until the append is done.
+    bool copying = atomic_load_explicit(&live_views, memory_order_acquire) > 0;
+    if (copying) pthread_mutex_lock(&append_copy_lock);
+    int slot = apply_session(m);
+    if (copying) pthread_mutex_unlock(&append_copy_lock);
+    pthread_rwlock_unlock(&append_lock);
+    return slot;
+}
+
+int apply_evaluation(const Mutation *m) {
+    int slot = find_case(m->case_id);
+    if (!valid_case_slot(slot)) return -1;
+    TherapyCase *c = case_for_write(slot);
+    if (c->session_count < EVALUATION_MIN_SESSIONS) return -1;
+    
+    TherapySession *last = session_for_write(c->last_session);
+    last->supervisor_feedback = str_put(m->feedback ? m->feedback : "");
+    text_index_add(last->supervisor_feedback, TEXT_OWNER(TEXT_FEEDBACK, c->last_session));
+    last->supervisor_reviewed = true;
+    c->clinical_rating = m->rating;
+    review_update(slot);
+    return slot;
+}
+
+int apply_close(const Mutation *m) {
+    int slot = find_case(m->case_id);
+    if (!valid_case_slot(slot)) return -1;
+    TherapyCase *c = case_for_write(slot);
+    if (!c->is_active || m->date == NO_DATE) return -1;
+    if (m->status <= CASE_ACTIVE || m->status >= CASE_STATUS_COUNT) return -1;
+    
+    c->end_date = m->date;
+    status_set(c->status, slot, false);
+    c->status = m->status;
+    status_set(c->status, slot, true);
+    c->clinical_rating = m->rating;
+    c->is_active = false;
+    review_update(slot);
+    
+    // Update therapist's case count
+    int therapist_slot = id_index_get(&therapist_index, c->therapist_id);
+    if (therapist_slot >= 0) {
+        therapist_at(therapist_slot)->current_cases--;
+        therapist_load_changed(therapist_slot);
+    }
+    return slot;
+}
+
+// Applies a mutation to the in-memory store. Returns the affected case slot,
+// or -1 if the mutation is not valid against the current state.
+int apply_mutation(const Mutation *m) {
+    METRIC_SCOPE(OP_APPLY_MUTATION);
+    switch (m->type) {
+        case MUT_NEW_CASE: return apply_new_case(m);
+        case MUT_ADD_GOAL: return apply_add_goal(m);
+        case MUT_MODIFY_GOAL: return apply_modify_goal(m);
+        case MUT_SESSION: return apply_session(m);
+        case MUT_EVALUATE: return apply_evaluation(m);
+        case MUT_CLOSE: return apply_close(m);
+        default: return -1;
+    }
+}
+
+int commit_mutation(const Mutation *m) {
+    int slot = apply_mutation(m);
+    if (slot >= 0) wal_append(m);
+    return slot;
+}
+
+void allocate_case(bool auto_allocate) {
+    print_menu_header("Allocate New Case");
+    
+    Mutation m = { MUT_NEW_CASE };
+    char name[100];
+    printf("Enter patient name: ");
+    clear_input_buffer();
+    fgets(name, sizeof(name), stdin);
+    name[strcspn(name, "\n")] = '\0';
+    m.name = name;
+    
+    printf("Enter diagnosis: ");
+    char diagnosis[200];
+    fgets(diagnosis, sizeof(diagnosis), stdin);
+    diagnosis[strcspn(diagnosis, "\n")] = '\0';
+    m.diagnosis = diagnosis;
+    
+    printf("Enter age: ");
+    scanf("%d", &m.age);
+    
+    printf("Enter gender (M/F/O): ");
+    scanf(" %c", &m.gender);
+    
+    printf("Enter contact number: ");
+    char contact[15];
+    scanf("%14s", contact);
+    m.contact = contact;
+    
+    printf("Enter admission date (YYYY-MM-DD): ");
+    m.date = read_date();
+    
+    if (auto_allocate) {
+        m.therapist_id = find_available_therapist(diagnosis);
+        if (m.therapist_id == -1) {
+            printf("No available therapists found. Please try manual allocation.\n");
+            return;
+        }
+        printf("Auto-assigned therapist: %s (ID: %d)\n", 
+               find_therapist(m.therapist_id)->name, m.therapist_id);
+    } else {
+        printf("\nAvailable Therapists:\n");
+        for (int i = 0; i < therapist_count; i++) {
+            printf("%d. %s (%s) - Current cases: %d\n", 
+                  therapist_at(i)->id, therapist_at(i)->name, 
+                  therapist_at(i)->specialization, therapist_at(i)->current_cases);
+        }
+        
+        printf("\nEnter therapist ID: ");
+        scanf("%d", &m.therapist_id);
+        if (find_therapist(m.therapist_id) == NULL) {
+            printf("Invalid therapist ID.\n");
+            return;
+        }
+    }
+    printf("\nAvailable Supervisors:\n");
+    for (int i = 0; i < supervisor_count; i++) {
+        printf("%d. %s\n", supervisor_at(i)->id, supervisor_at(i)->name);
+    }
+    
+    printf("\nEnter supervisor ID: ");
+    scanf("%d", &m.supervisor_id);
+    if (find_supervisor(m.supervisor_id) == NULL) {
+        printf("Invalid supervisor ID.\n");
+        return;
+    }
+    
+    int slot = commit_mutation(&m);
+    if (slot < 0) {
+        printf("Could not allocate case.\n");
+        return;
+    }
+    printf("\nCase allocated successfully. Case ID: %d\n", case_at(slot)->id);
+}
+
+static const SpecialtyBucket specialty_buckets[SPECIALTY_BUCKETS] = {
+    { "general", { NULL } },
+    { "child", { "child", "pediatric", "paediatric", "developmental", "articulation", "stutter",
+                 "fluency", "delay", "autism", "phonolog", "lisp", NULL } },
+    { "aphasia", { "aphasia", "stroke", "brain injury", "neurolog", "dysarthria", "apraxia",
+                   "dementia", NULL } },
+    { "voice", { "voice", "vocal", "hoarse", "laryn", "resonance", "nodule", "pitch", NULL } },
+    { "swallowing", { "dysphagia", "swallow", "feeding", NULL } },
+};
+
+// Returns the bucket whose keywords occur most often in the text, or the
+// general bucket when none do.
+int match_specialty(const char *text) {
+    char lower[256];
+    snprintf(lower, sizeof(lower), "%s", text ? text : "");
+    to_lower_case(lower);
+    
+    int best = 0, best_hits = 0;
+    for (int b = 1; b < SPECIALTY_BUCKETS; b++) {
+        int hits = 0;
+        for (int k = 0; specialty_buckets[b].keywords[k]; k++) {
+            if (strstr(lower, specialty_buckets[b].keywords[k])) hits++;
+        }
+        if (hits > best_hits) {
+            best = b;
+            best_hits = hits;
+        }
+    }
+    return best;
+}
+
+static inline bool therapist_less(int a, int b) {
+    const Therapist *x = therapist_at(a), *y = therapist_at(b);
+    return x->current_cases < y->current_cases ||
+           (x->current_cases == y->current_cases && x->id < y->id);
+}
+
+static void heap_swap(TherapistHeap *h, int i, int j) {
+    int t = h->slots[i];
+    h->slots[i] = h->slots[j];
+    h->slots[j] = t;
+    therapist_heap_pos[h->slots[i]] = i;
+    therapist_heap_pos[h->slots[j]] = j;
+}
+
+static void heap_sift_up(TherapistHeap *h, int i) {
+    while (i > 0 && therapist_less(h->slots[i], h->slots[(i - 1) / 2])) {
+        heap_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_sift_down(TherapistHeap *h, int i) {
+    for (;;) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < h->count && therapist_less(h->slots[l], h->slots[smallest])) smallest = l;
+        if (r < h->count && therapist_less(h->slots[r], h->slots[smallest])) smallest = r;
+        if (smallest == i) return;
+        heap_swap(h, i, smallest);
+        i = smallest;
+    }
+}
+
+// Built on first use. Caseloads are recounted from the active cases so a
+// drifted current_cases (e.g. from older data files) cannot skew allocation.
+void ensure_allocation_engine() {
+    if (allocation_ready) return;
+    allocation_ready = true;
+    
+    for (int i = 0; i < therapist_count; i++) therapist_at(i)->current_cases = 0;
+    for (int i = 0; i < case_count; i++) {
+        if (!case_at(i)->is_active) continue;
+        int t = id_index_get(&therapist_index, case_at(i)->therapist_id);
+        if (t >= 0) therapist_at(t)->current_cases++;
+    }
+    
+    therapist_heap_pos = malloc((therapist_count + 1) * sizeof(int));
+    therapist_bucket = malloc(therapist_count + 1);
+    if (therapist_heap_pos == NULL || therapist_bucket == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (int i = 0; i < therapist_count; i++) {
+        int b = match_specialty(therapist_at(i)->specialization);
+        TherapistHeap *h = &therapist_heaps[b];
+        if (h->count == h->capacity) {
+            int capacity = h->capacity ? h->capacity * 2 : 8;
+            int *slots = realloc(h->slots, capacity * sizeof(int));
+            if (slots == NULL) {
+                printf("Out of memory.\n");
+                exit(1);
+            }
+            h->slots = slots;
+            h->capacity = capacity;
+        }
+        therapist_bucket[i] = b;
+        therapist_heap_pos[i] = h->count;
+        h->slots[h->count++] = i;
+        heap_sift_up(h, h->count - 1);
+    }
+}
+
+// Restores heap order after a therapist's caseload changed by one.
+void therapist_load_changed(int slot) {
+    if (!allocation_ready || slot < 0) return;
+    TherapistHeap *h = &therapist_heaps[therapist_bucket[slot]];
+    heap_sift_up(h, therapist_heap_pos[slot]);
+    heap_sift_down(h, therapist_heap_pos[slot]);
+}
+
+// Least loaded therapist in the bucket, falling back to the least loaded
+// therapist overall when every specialist is at the caseload limit.
+int allocation_pick(int bucket) {
+    TherapistHeap *h = &therapist_heaps[bucket];
+    if (h->count > 0 && therapist_at(h->slots[0])->current_cases < caseload_limit) {
+        return h->slots[0];
+    }
+    int best = -1;
+    for (int b = 0; b < SPECIALTY_BUCKETS; b++) {
+        h = &therapist_heaps[b];
+        if (h->count == 0 || therapist_at(h->slots[0])->current_cases >= caseload_limit) continue;
+        if (best < 0 || therapist_less(h->slots[0], best)) best = h->slots[0];
+    }
+    return best;
+}
+
+int find_available_therapist(const char *diagnosis) {
+    ensure_allocation_engine();
+    int slot = allocation_pick(match_specialty(diagnosis));
+    return slot < 0 ? -1 : therapist_at(slot)->id;
+}
+
+// Assigns therapists to every queued admission whose therapist_id is 0.
+// Specialty matches are placed before general admissions so generalist
+// cases do not use up a specialist's remaining capacity. Loads are only
+// held while planning; committing the admissions adds them for real.
+// Returns the number of admissions that were assigned.
+int allocate_admissions(Mutation *queue, int n) {
+    ensure_allocation_engine();
+    int *held = malloc((n + 1) * sizeof(int));
+    if (held == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    
+    int assigned = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            if (queue[i].type != MUT_NEW_CASE || queue[i].therapist_id != 0) continue;
+            int bucket = match_specialty(queue[i].diagnosis);
+            if ((bucket != 0) != (pass == 0)) continue;
+            int slot = allocation_pick(bucket);
+            if (slot < 0) continue;
+            queue[i].therapist_id = therapist_at(slot)->id;
+            therapist_at(slot)->current_cases++;
+            therapist_load_changed(slot);
+            held[assigned++] = slot;
+        }
+    }
+    for (int i = 0; i < assigned; i++) {
+        therapist_at(held[i])->current_cases--;
+        therapist_load_changed(held[i]);
+    }
+    free(held);
+    return assigned;
+}
+
+void create_therapy_plan(int case_index) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    print_menu_header("Create/Modify Therapy Plan");
+    
+    printf("Case ID: %d | Patient ID: %d\n", c->id, c->patient_id);
+    printf("Current goals: %d\n", c->goal_count);
+    
+    TherapyGoal *goals = case_goals(case_index);
+    char text[STR_MAX_LEN + 1];
+    if (c->goal_count > 0) {
+        printf("\nExisting Goals:\n");
+        for (int i = 0; i < c->goal_count; i++) {
+            printf("%d. %s (Target: %d sessions, Achieved: %d, Status: %s)\n", 
+                  goals[i].id, str_get(goals[i].description, text, sizeof(text)),
+                  goals[i].target_sessions, goals[i].achieved,
+                  goal_status_names[goals[i].status]);
+        }
+        
+        printf("\n1. Add new goals\n2. Modify existing goals\n3. Cancel\nChoice: ");
+        int choice;
+        scanf("%d", &choice);
+        
+        if (choice == 2) {
+            Mutation m = { MUT_MODIFY_GOAL };
+            m.case_id = c->id;
+            printf("Enter goal number to modify: ");
+            scanf("%d", &m.goal_num);
+            if (m.goal_num < 1 || m.goal_num > c->goal_count) {
+                printf("Invalid goal number.\n");
+                return;
+            }
+            
+            TherapyGoal *g = &goals[m.goal_num-1];
+            printf("\nEditing Goal %d:\n", m.goal_num);
+            printf("Current description: %s\n", str_get(g->description, text, sizeof(text)));
+            printf("New description (or press enter to keep): ");
+            clear_input_buffer();
+            char new_desc[200];
+            fgets(new_desc, sizeof(new_desc), stdin);
+            new_desc[strcspn(new_desc, "\n")] = '\0';
+            m.description = new_desc;
+            
+            printf("Current target sessions: %d\n", g->target_sessions);
+            printf("New target sessions (or 0 to keep): ");
+            scanf("%d", &m.target_sessions);
+            
+            commit_mutation(&m);
+            printf("Goal updated successfully.\n");
+            return;
+        } else if (choice == 3) {
+            return;
+        }
+    }
+    
+    int goal_count;
+    printf("\nEnter number of therapy goals to add (max %d): ", MAX_GOALS - c->goal_count);
+    scanf("%d", &goal_count);
+    
+    if (goal_count <= 0 || goal_count > (MAX_GOALS - c->goal_count)) {
+        printf("Invalid number of goals.\n");
+        return;
+    }
+    
+    clear_input_buffer();
+    for (int i = 0; i < goal_count; i++) {
+        Mutation m = { MUT_ADD_GOAL };
+        m.case_id = c->id;
+        
+        printf("\nGoal %d:\n", c->goal_count + 1);
+        printf("Enter description: ");
+        char description[200];
+        fgets(description, sizeof(description), stdin);
+        description[strcspn(description, "\n")] = '\0';
+        m.description = description;
+        
+        printf("Enter target sessions: ");
+        scanf("%d", &m.target_sessions);
+        clear_input_buffer();
+        
+        commit_mutation(&m);
+    }
+    
+    printf("\nTherapy plan updated successfully. Total goals: %d\n", c->goal_count);
+}
+
+void record_session(int case_index) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    if (!c->is_active) {
+        printf("This case is not active. Cannot record sessions.\n");
+        return;
+    }
+    
+    print_menu_header("Record Therapy Session");
+    
+    Mutation m = { MUT_SESSION };
+    m.case_id = c->id;
+    
+    printf("Enter session date (YYYY-MM-DD) or 'today' for current date: ");
+    char date_input[11];
+    scanf("%10s", date_input);
+    
+    if (strcmp(date_input, "today") == 0) {
+        m.date = date_today();
+    } else {
+        while (!parse_date(date_input, &m.date)) {
+            printf("Invalid date. Please use YYYY-MM-DD: ");
+            scanf("%10s", date_input);
+        }
+    }
+    
+    clear_input_buffer();
+    printf("Session Date: %s\n", date_text(m.date).text);
+    char activities[500];
+    printf("Enter activities performed: ");
+    fgets(activities, sizeof(activities), stdin);
+    activities[strcspn(activities, "\n")] = '\0';
+    m.activities = activities;
+    
+    char observations[500];
+    printf("Enter observations: ");
+    fgets(observations, sizeof(observations), stdin);
+    observations[strcspn(observations, "\n")] = '\0';
+    m.observations = observations;
+    
+    if (c->goal_count > 0) {
+        printf("\nUpdate goal progress? (1=Yes, 0=No): ");
+        int update;
+        scanf("%d", &update);
+        if (update) {
+            printf("Select goal to update:\n");
+            TherapyGoal *goals = case_goals(case_index);
+            char text[STR_MAX_LEN + 1];
+            for (int i = 0; i < c->goal_count; i++) {
+                printf("%d. %s\n", goals[i].id, str_get(goals[i].description, text, sizeof(text)));
+            }
+            printf("Goal number: ");
+            scanf("%d", &m.goal_num);
+        }
+    }
+    
+    commit_mutation(&m);
+    if (m.goal_num >= 1 && m.goal_num <= c->goal_count) {
+        printf("Goal %d progress updated.\n", m.goal_num);
+    }
+    printf("\nSession recorded successfully. Total sessions: %d\n", c->session_count);
+}
+
+void report_reserve(ReportWriter *w, size_t extra) {
+    if (w->len + extra <= w->capacity) return;
+    size_t capacity = w->capacity ? w->capacity : REPORT_BUFFER_BYTES;
+    while (capacity < w->len + extra) capacity *= 2;
+    char *data = realloc(w->data, capacity);
+    if (data == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    w->data = data;
+    w->capacity = capacity;
+}
+
+void report_flush(ReportWriter *w) {
+    for (int i = 0; i < w->sink_count; i++) {
+        fwrite(w->data, 1, w->len, w->sinks[i]);
+    }
+    METRIC_ADD(MC_REPORT_BYTES, w->len * w->sink_count);
+    if (w->sink_count > 0) w->len = 0;
+}
+
+void report_printf(ReportWriter *w, const char *fmt, ...) {
+    if (w->capacity == 0) report_reserve(w, REPORT_BUFFER_BYTES);
+    
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->data + w->len, w->capacity - w->len, fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    
+    if (w->len + n >= w->capacity) {
+        if (w->sink_count > 0) report_flush(w);
+        report_reserve(w, n + 1);
+        va_start(args, fmt);
+        vsnprintf(w->data + w->len, w->capacity - w->len, fmt, args);
+        va_end(args);
+    }
+    w->len += n;
+    
+    if (w->sink_count > 0 && w->len >= REPORT_BUFFER_BYTES / 2) report_flush(w);
+}
+
+void report_free(ReportWriter *w) {
+    free(w->data);
+    w->data = NULL;
+    w->len = w->capacity = 0;
+}
+
+// Formats the full progress report of one case, including every session.
+bool write_progress_report(ReportWriter *w, int case_index) {
+    METRIC_SCOPE(OP_PROGRESS_REPORT);
+    TherapyCase *c = case_at(case_index);
+    Patient *p = find_patient(c->patient_id);
+    if (p == NULL) return false;
+    char text[STR_MAX_LEN + 1];
+    
+    report_printf(w, "\nPROGRESS REPORT\n");
+    report_printf(w, "Case ID: %d\n", c->id);
+    report_printf(w, "Patient: %s (ID: %d)\n", p->name, p->id);
+    report_printf(w, "Diagnosis: %s\n", str_get(p->diagnosis, text, sizeof(text)));
+    report_printf(w, "Age: %d, Gender: %c\n", p->age, p->gender);
+    report_printf(w, "Admission Date: %s\n", date_text(p->admission_date).text);
+    
+    Therapist *t = find_therapist(c->therapist_id);
+    if (t != NULL) {
+        report_printf(w, "\nTherapist: %s (%s)\n", t->name, t->specialization);
+    }
+    
+    Supervisor *sup = find_supervisor(c->supervisor_id);
+    if (sup != NULL) {
+        report_printf(w, "Supervisor: %s\n", sup->name);
+    }
+    
+    report_printf(w, "\nCase Status: %s\n", case_status_names[c->status]);
+    report_printf(w, "Start Date: %s\n", date_text(c->start_date).text);
+    if (c->end_date != NO_DATE) {
+        report_printf(w, "End Date: %s\n", date_text(c->end_date).text);
+    }
+    report_printf(w, "Clinical Rating: %.1f/5.0\n", c->clinical_rating);
+    
+    report_printf(w, "\nTHERAPY GOALS:\n");
+    const TherapyGoal *goals = case_goals(case_index);
+    for (int i = 0; i < c->goal_count; i++) {
+        report_printf(w, "%d. %s\n   Target: %d sessions, Achieved: %d, Status: %s\n", 
+                      goals[i].id, str_get(goals[i].description, text, sizeof(text)),
+                      goals[i].target_sessions, goals[i].achieved,
+                      goal_status_names[goals[i].status]);
+    }
+    
+    report_printf(w, "\nTOTAL SESSIONS COMPLETED: %d\n", session_total(c));
+    
+    report_printf(w, "\nSESSION HISTORY:\n");
+    for (int idx = session_first(c); idx != NO_SESSION; idx = session_next(idx)) {
+        TherapySession *s = session_at(idx);
+        report_printf(w, "\nSession %d on %s\n", s->session_id, date_text(s->date).text);
+        report_printf(w, "Activities: %s\n", str_get(s->activities, text, sizeof(text)));
+        report_printf(w, "Observations: %s\n", str_get(s->observations, text, sizeof(text)));
+        if (s->supervisor_feedback != 0) {
+            report_printf(w, "Supervisor Feedback: %s\n", str_get(s->supervisor_feedback, text, sizeof(text)));
+        }
+    }
+    return true;
+}
+
+void generate_progress_report(int case_index, bool export_to_file) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    print_menu_header("Progress Report");
+    
+    if (find_patient(c->patient_id) == NULL) {
+        printf("Patient not found.\n");
+        return;
+    }
+    
+    ReportWriter w = { 0 };
+    w.sinks[w.sink_count++] = stdout;
+    
+    char filename[50];
+    FILE *file = NULL;
+    if (export_to_file) {
+        snprintf(filename, sizeof(filename), "Case_%d_Report.txt", c->id);
+        file = fopen(filename, "w");
+        if (file) w.sinks[w.sink_count++] = file;
+    }
+    
+    write_progress_report(&w, case_index);
+    report_flush(&w);
+    report_free(&w);
+    
+    if (export_to_file) {
+        if (file && fclose(file) == 0) {
+            printf("\nReport saved to %s\n", filename);
+        } else {
+            printf("\nError saving report to file.\n");
+        }
+    }
+}
+
+// Bulk export. Matching cases are collected up front together with a read
+// view, so the export shows one point in time even while writers carry on;
+// worker threads then claim cases one at a time from a shared counter, each
+// formatting into its own ReportWriter. Archive output is appended under a
+// lock one batch of complete reports at a time, so reports never interleave.
+typedef struct {
+    ReadView *view;
+    int *slots;
+    int count;
+    atomic_int next;
+    atomic_int written;
+    FILE *archive;
+    pthread_mutex_t archive_lock;
+} ExportJob;
+
+void collect_slot(int slot, void *ctx) {
+    case_list_add((CaseList *)ctx, slot);
+}
+
+bool case_in_date_range(const TherapyCase *c, Date from, Date to) {
+    if (to != NO_DATE && c->start_date > to) return false;
+    if (from != NO_DATE && c->end_date != NO_DATE && c->end_date < from) return false;
+    return true;
+}
+
+void archive_append(ExportJob *job, ReportWriter *w) {
+    pthread_mutex_lock(&job->archive_lock);
+    fwrite(w->data, 1, w->len, job->archive);
+    pthread_mutex_unlock(&job->archive_lock);
+    w->len = 0;
+}
+
+void *export_worker(void *arg) {
+    ExportJob *job = arg;
+    ReportWriter w = { 0 };
+    read_view_enter(job->view);
+    
+    while (1) {
+        int k = atomic_fetch_add(&job->next, 1);
+        if (k >= job->count) break;
+        int slot = job->slots[k];
+        
+        if (job->archive != NULL) {
+            if (write_progress_report(&w, slot)) atomic_fetch_add(&job->written, 1);
+            if (w.len >= EXPORT_ARCHIVE_FLUSH_BYTES) archive_append(job, &w);
+        } else {
+            char filename[50];
+            snprintf(filename, sizeof(filename), "Case_%d_Report.txt", case_at(slot)->id);
+            FILE *file = fopen(filename, "w");
+            if (file == NULL) continue;
+            w.sinks[0] = file;
+            w.sink_count = 1;
+            bool ok = write_progress_report(&w, slot);
+            report_flush(&w);
+            if (fclose(file) == 0 && ok) atomic_fetch_add(&job->written, 1);
+        }
+    }
+    
+    if (job->archive != NULL && w.len > 0) archive_append(job, &w);
+    report_free(&w);
+    read_view_enter(NULL);
+    return NULL;
+}
+
+// Writes a report for every case matching the filter, either as one
+// Case_<id>_Report.txt per case or concatenated into archive_path.
+// Returns the number of reports written, or -1 on error.
+int export_reports(const ExportFilter *filter, const char *archive_path) {
+    METRIC_SCOPE(OP_EXPORT_REPORTS);
+    CaseList matches = { 0 };
+    ExportJob job = { 0 };
+    pthread_rwlock_rdlock(&store_lock);
+    query_cases(&filter->query, collect_slot, &matches);
+    job.slots = matches.items;
+    for (int k = 0; k < matches.count; k++) {
+        if (case_in_date_range(case_at(matches.items[k]), filter->from, filter->to)) {
+            job.slots[job.count++] = matches.items[k];
+        }
+    }
+    job.view = read_view_open();
+    pthread_rwlock_unlock(&store_lock);
+    atomic_init(&job.next, 0);
+    atomic_init(&job.written, 0);
+    pthread_mutex_init(&job.archive_lock, NULL);
+    
+    if (archive_path != NULL) {
+        job.archive = fopen(archive_path, "w");
+        if (job.archive == NULL) {
+            read_view_close(job.view);
+            free(matches.items);
+            return -1;
+        }
+    }
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    if (threads > EXPORT_MAX_THREADS) threads = EXPORT_MAX_THREADS;
+    if (threads > job.count) threads = job.count > 0 ? job.count : 1;
+    
+    pthread_t workers[EXPORT_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, export_worker, &job) == 0) started++;
+    }
+    export_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    
+    int written = atomic_load(&job.written);
+    if (job.archive != NULL && fclose(job.archive) != 0) written = -1;
+    pthread_mutex_destroy(&job.archive_lock);
+    read_view_close(job.view);
+    free(matches.items);
+    return written;
+}
+
+// Months are numbered year * 12 + month - 1 so they sort and subtract as ints.
+static int32_t date_month(Date date) {
+    if (date == NO_DATE) return -1;
+    int year, month, day;
+    date_to_ymd(date, &year, &month, &day);
+    return year * 12 + month - 1;
+}
+
+static void *column_alloc(int count, size_t size) {
+    void *column = calloc(count > 0 ? count : 1, size);
+    if (column == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    return column;
+}
+
+// Diagnoses are grouped by their lowercased text.
+static int32_t diagnosis_code(CaseColumns *cols, uint32_t **table, uint32_t *capacity, const char *text) {
+    char key[128];
+    snprintf(key, sizeof(key), "%s", text);
+    to_lower_case(key);
+    size_t len = strlen(key);
+    
+    if ((uint32_t)(cols->diagnosis_count + 1) * 2 > *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 1024;
+        uint32_t *fresh = column_alloc(grown, sizeof(uint32_t));
+        for (int i = 0; i < cols->diagnosis_count; i++) {
+            uint32_t h = text_hash(cols->diagnosis_names[i], strlen(cols->diagnosis_names[i])) & (grown - 1);
+            while (fresh[h] != 0) h = (h + 1) & (grown - 1);
+            fresh[h] = i + 1;
+        }
+        free(*table);
+        *table = fresh;
+        *capacity = grown;
+        char **names = realloc(cols->diagnosis_names, grown / 2 * sizeof(char *));
+        if (names == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        cols->diagnosis_names = names;
+    }
+    
+    uint32_t mask = *capacity - 1;
+    uint32_t h = text_hash(key, len) & mask;
+    while ((*table)[h] != 0) {
+        if (strcmp(cols->diagnosis_names[(*table)[h] - 1], key) == 0) return (*table)[h] - 1;
+        h = (h + 1) & mask;
+    }
+    cols->diagnosis_names[cols->diagnosis_count] = strdup(key);
+    (*table)[h] = ++cols->diagnosis_count;
+    return cols->diagnosis_count - 1;
+}
+
+void build_case_columns(CaseColumns *cols) {
+    memset(cols, 0, sizeof(*cols));
+    int n = cols->count = case_count;
+    cols->therapist = column_alloc(n, sizeof(int32_t));
+    cols->supervisor = column_alloc(n, sizeof(int32_t));
+    cols->diagnosis = column_alloc(n, sizeof(int32_t));
+    cols->sessions = column_alloc(n, sizeof(int32_t));
+    cols->goals = column_alloc(n, sizeof(int32_t));
+    cols->goals_completed = column_alloc(n, sizeof(int32_t));
+    cols->achieved = column_alloc(n, sizeof(int32_t));
+    cols->target = column_alloc(n, sizeof(int32_t));
+    cols->rating = column_alloc(n, sizeof(float));
+    cols->active = column_alloc(n, sizeof(uint8_t));
+    cols->selected = column_alloc(n, sizeof(uint8_t));
+    
+    uint32_t *table = NULL, capacity = 0;
+    char text[STR_MAX_LEN + 1];
+    for (int i = 0; i < n; i++) {
+        const TherapyCase *c = case_at(i);
+        // Ids are normally assigned densely, so try the matching slot first.
+        int t = c->therapist_id - 1;
+        if (t < 0 || t >= therapist_count || therapist_at(t)->id != c->therapist_id) {
+            t = id_index_get(&therapist_index, c->therapist_id);
+        }
+        cols->therapist[i] = t >= 0 ? t : therapist_count;
+        cols->supervisor[i] = c->supervisor_id;
+        const Patient *p = i < patient_count && patient_at(i)->id == c->patient_id ? patient_at(i) : find_patient(c->patient_id);
+        cols->diagnosis[i] = diagnosis_code(cols, &table, &capacity, p ? str_get(p->diagnosis, text, sizeof(text)) : "");
+        cols->sessions[i] = c->session_count;
+        cols->rating[i] = c->clinical_rating;
+        cols->active[i] = c->is_active;
+        
+        int goals = c->goal_count < MAX_GOALS ? c->goal_count : MAX_GOALS;
+        cols->goals[i] = goals;
+        const TherapyGoal *goal = case_goals(i);
+        for (int g = 0; g < goals; g++) {
+            cols->goals_completed[i] += goal[g].achieved >= goal[g].target_sessions;
+            cols->achieved[i] += goal[g].achieved < goal[g].target_sessions ?
+                                 goal[g].achieved : goal[g].target_sessions;
+            cols->target[i] += goal[g].target_sessions;
+        }
+    }
+    free(table);
+    
+    int m = cols->session_count = session_log_count;
+    cols->session_case = column_alloc(m, sizeof(int32_t));
+    cols->session_month = column_alloc(m, sizeof(int32_t));
+    for (int i = 0; i < m; i++) {
+        const TherapySession *s = session_at(i);
+        int slot = s->case_id - 1;
+        if (slot < 0 || slot >= n || case_at(slot)->id != s->case_id) slot = find_case(s->case_id);
+        cols->session_case[i] = slot;
+        cols->session_month[i] = date_month(s->date);
+    }
+}
+
+void free_case_columns(CaseColumns *cols) {
+    free(cols->therapist);
+    free(cols->supervisor);
+    free(cols->diagnosis);
+    free(cols->sessions);
+    free(cols->goals);
+    free(cols->goals_completed);
+    free(cols->achieved);
+    free(cols->target);
+    free(cols->rating);
+    free(cols->active);
+    free(cols->selected);
+    free(cols->session_case);
+    free(cols->session_month);
+    for (int i = 0; i < cols->diagnosis_count; i++) free(cols->diagnosis_names[i]);
+    free(cols->diagnosis_names);
+}
+
+// Aggregation kernels. Each is a single pass over contiguous columns with
+// no branches in the loop body, so the compiler can unroll and vectorise
+// the arithmetic; group updates are indexed adds into dense arrays.
+static void select_supervisor(const int32_t *supervisor, uint8_t *selected, int n, int supervisor_id) {
+    for (int i = 0; i < n; i++) selected[i] = (supervisor_id == 0) | (supervisor[i] == supervisor_id);
+}
+
+static void group_count(const int32_t *key, const uint8_t *mask, int n, int64_t *counts) {
+    for (int i = 0; i < n; i++) counts[key[i]] += mask[i];
+}
+
+static void group_sum(const int32_t *key, const int32_t *value, const uint8_t *mask, int n, int64_t *sums) {
+    for (int i = 0; i < n; i++) sums[key[i]] += (int64_t)value[i] * mask[i];
+}
+
+static void group_rating(const int32_t *key, const float *rating, const uint8_t *mask, int n,
+                         double *sums, int64_t *counts) {
+    for (int i = 0; i < n; i++) {
+        int rated = mask[i] & (rating[i] > 0.0f);
+        sums[key[i]] += rating[i] * rated;
+        counts[key[i]] += rated;
+    }
+}
+
+static double elapsed_ms_precise(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Caseload, monthly session volume, outcome by diagnosis and goal
+// completion, either clinic-wide or for one supervisor's cases.
+void print_analytics(int supervisor_id) {
+    METRIC_SCOPE(OP_ANALYTICS);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CaseColumns cols;
+    build_case_columns(&cols);
+    double build_ms = elapsed_ms_precise(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    int n = cols.count, groups = therapist_count + 1;
+    select_supervisor(cols.supervisor, cols.selected, n, supervisor_id);
+    
+    int64_t *cases = column_alloc(groups, sizeof(int64_t));
+    int64_t *active = column_alloc(groups, sizeof(int64_t));
+    int64_t *sessions = column_alloc(groups, sizeof(int64_t));
+    int64_t *goals = column_alloc(groups, sizeof(int64_t));
+    int64_t *completed = column_alloc(groups, sizeof(int64_t));
+    int64_t *achieved = column_alloc(groups, sizeof(int64_t));
+    int64_t *target = column_alloc(groups, sizeof(int64_t));
+    int64_t *rated = column_alloc(groups, sizeof(int64_t));
+    double *rating_sum = column_alloc(groups, sizeof(double));
+    uint8_t *active_selected = column_alloc(n, sizeof(uint8_t));
+    for (int i = 0; i < n; i++) active_selected[i] = cols.active[i] & cols.selected[i];
+    
+    group_count(cols.therapist, cols.selected, n, cases);
+    group_count(cols.therapist, active_selected, n, active);
+    group_sum(cols.therapist, cols.sessions, cols.selected, n, sessions);
+    group_sum(cols.therapist, cols.goals, cols.selected, n, goals);
+    group_sum(cols.therapist, cols.goals_completed, cols.selected, n, completed);
+    group_sum(cols.therapist, cols.achieved, cols.selected, n, achieved);
+    group_sum(cols.therapist, cols.target, cols.selected, n, target);
+    group_rating(cols.therapist, cols.rating, cols.selected, n, rating_sum, rated);
+    
+    int dn = cols.diagnosis_count;
+    int64_t *diagnosis_cases = column_alloc(dn, sizeof(int64_t));
+    int64_t *diagnosis_rated = column_alloc(dn, sizeof(int64_t));
+    double *diagnosis_rating = column_alloc(dn, sizeof(double));
+    group_count(cols.diagnosis, cols.selected, n, diagnosis_cases);
+    group_rating(cols.diagnosis, cols.rating, cols.selected, n, diagnosis_rating, diagnosis_rated);
+    
+    // Sessions per therapist per month: the session rows take their
+    // therapist and selection from their case, then group on a combined key.
+    // Rows are only given to months that have sessions, so one mistyped
+    // far-off date adds a row rather than every month in between; past
+    // ANALYTICS_MAX_MONTHS rows the oldest months share an "Earlier" row.
+    int m = cols.session_count;
+    int32_t first_month = INT32_MAX, last_month = -1;
+    for (int i = 0; i < m; i++) {
+        int32_t month = cols.session_month[i];
+        if (month >= 0 && month < first_month) first_month = month;
+        if (month > last_month) last_month = month;
+    }
+    int span = last_month >= first_month ? last_month - first_month + 1 : 0;
+    int32_t *month_row = column_alloc(span, sizeof(int32_t));
+    int present = 0;
+    for (int i = 0; i < m; i++) {
+        if (cols.session_month[i] >= 0) month_row[cols.session_month[i] - first_month] = 1;
+    }
+    for (int k = 0; k < span; k++) present += month_row[k];
+    int folded = present > ANALYTICS_MAX_MONTHS ? present - ANALYTICS_MAX_MONTHS + 1 : 0;
+    int rows = 0, seen = 0;
+    int32_t *row_month = column_alloc(present < ANALYTICS_MAX_MONTHS ? present : ANALYTICS_MAX_MONTHS, sizeof(int32_t));
+    for (int k = 0; k < span; k++) {
+        if (!month_row[k]) continue;
+        if (seen++ >= folded || rows == 0) row_month[rows++] = first_month + k;
+        month_row[k] = rows - 1;
+    }
+    size_t cells = (size_t)rows * groups;
+    if (cells > INT32_MAX) {
+        printf("Too many therapists to tabulate sessions by month.\n");
+        rows = 0;
+        cells = 0;
+    }
+    int64_t *monthly = column_alloc((int)cells, sizeof(int64_t));
+    int32_t *session_key = column_alloc(m, sizeof(int32_t));
+    uint8_t *session_selected = column_alloc(m, sizeof(uint8_t));
+    for (int i = 0; i < m; i++) {
+        int slot = cols.session_case[i];
+        bool valid = rows > 0 && slot >= 0 && cols.session_month[i] >= 0;
+        session_key[i] = valid ? month_row[cols.session_month[i] - first_month] * groups + cols.therapist[slot] : 0;
+        session_selected[i] = valid && cols.selected[slot];
+    }
+    group_count(session_key, session_selected, m, monthly);
+    double query_ms = elapsed_ms_precise(&start);
+    
+    print_menu_header(supervisor_id ? "Caseload Analytics (Supervised Cases)" : "Clinic Analytics");
+    
+    printf("\nCaseload and Outcomes by Therapist:\n");
+    printf("Therapist\t\tCases\tActive\tSessions\tAvg Rating\tGoals Met\tProgress\n");
+    printf("--------------------------------------------------------------------------------------------\n");
+    for (int t = 0; t < groups; t++) {
+        if (cases[t] == 0) continue;
+        const char *name = t < therapist_count ? therapist_at(t)->name : "Unassigned";
+        printf("%-20.20s\t%lld\t%lld\t%lld\t\t", name, (long long)cases[t], (long long)active[t], (long long)sessions[t]);
+        if (rated[t] > 0) printf("%.2f\t\t", rating_sum[t] / rated[t]);
+        else printf("-\t\t");
+        printf("%lld/%lld\t\t%.1f%%\n", (long long)completed[t], (long long)goals[t],
+               target[t] > 0 ? 100.0 * achieved[t] / target[t] : 0.0);
+    }
+    
+    // Straight from the status bitmaps rather than the columns.
+    const CaseList *supervised = supervisor_id ? posting_get(&cases_by_supervisor, supervisor_id) : NULL;
+    printf("\nCases by Status:");
+    for (int status = CASE_ACTIVE; status < CASE_STATUS_COUNT; status++) {
+        int count = supervisor_id && supervised == NULL ? 0 : status_count(status, supervised);
+        printf("  %s %d", case_status_names[status], count);
+    }
+    printf("\n");
+    
+    printf("\nSessions per Therapist per Month:\n");
+    printf("Month\t");
+    for (int t = 0; t < therapist_count; t++) printf("\t%.12s", therapist_at(t)->name);
+    printf("\n");
+    for (int k = 0; k < rows; k++) {
+        int64_t total = 0;
+        for (int t = 0; t < groups; t++) total += monthly[(size_t)k * groups + t];
+        if (total == 0) continue;
+        int month = row_month[k];
+        if (k == 0 && folded > 0) printf("Earlier\t");
+        else printf("%04d-%02d\t", month / 12, month % 12 + 1);
+        for (int t = 0; t < therapist_count; t++) printf("\t%lld", (long long)monthly[(size_t)k * groups + t]);
+        printf("\n");
+    }
+    
+    printf("\nAverage Clinical Rating by Diagnosis (top %d by cases):\n", ANALYTICS_TOP_DIAGNOSES);
+    printf("Cases\tRated\tAvg Rating\tDiagnosis\n");
+    printf("------------------------------------------------\n");
+    int top[ANALYTICS_TOP_DIAGNOSES], top_count = 0;
+    for (int d = 0; d < dn; d++) {
+        if (diagnosis_cases[d] == 0) continue;
+        if (top_count == ANALYTICS_TOP_DIAGNOSES && diagnosis_cases[d] <= diagnosis_cases[top[top_count - 1]]) continue;
+        int j = top_count < ANALYTICS_TOP_DIAGNOSES ? top_count++ : top_count - 1;
+        while (j > 0 && diagnosis_cases[top[j - 1]] < diagnosis_cases[d]) {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = d;
+    }
+    for (int k = 0; k < top_count; k++) {
+        int d = top[k];
+        printf("%lld\t%lld\t", (long long)diagnosis_cases[d], (long long)diagnosis_rated[d]);
+        if (diagnosis_rated[d] > 0) printf("%.2f\t\t", diagnosis_rating[d] / diagnosis_rated[d]);
+        else printf("-\t\t");
+        printf("%.50s\n", cols.diagnosis_names[d][0] ? cols.diagnosis_names[d] : "(none)");
+    }
+    
+    int64_t all_goals = 0, all_completed = 0, all_achieved = 0, all_target = 0;
+    for (int t = 0; t < groups; t++) {
+        all_goals += goals[t];
+        all_completed += completed[t];
+        all_achieved += achieved[t];
+        all_target += target[t];
+    }
+    printf("\nGoal Completion: %lld of %lld goals met (%.1f%%), %.1f%% of targeted sessions achieved\n",
+           (long long)all_completed, (long long)all_goals,
+           all_goals > 0 ? 100.0 * all_completed / all_goals : 0.0,
+           all_target > 0 ? 100.0 * all_achieved / all_target : 0.0);
+    printf("(%d cases, %d sessions: columns built in %.1f ms, aggregated in %.1f ms)\n",
+           n, m, build_ms, query_ms);
+    
+    free(cases);
+    free(active);
+    free(sessions);
+    free(goals);
+    free(completed);
+    free(achieved);
+    free(target);
+    free(rated);
+    free(rating_sum);
+    free(active_selected);
+    free(diagnosis_cases);
+    free(diagnosis_rated);
+    free(diagnosis_rating);
+    free(monthly);
+    free(month_row);
+    free(row_month);
+    free(session_key);
+    free(session_selected);
+    free_case_columns(&cols);
+}
+
+void evaluate_case(int case_index) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    print_menu_header("Case Evaluation");
+    
+    if (c->session_count < EVALUATION_MIN_SESSIONS) {
+        printf("Evaluation requires at least %d sessions. Current sessions: %d\n", 
+               EVALUATION_MIN_SESSIONS, c->session_count);
+        return;
+    }
+    
+    Mutation m = { MUT_EVALUATE };
+    m.case_id = c->id;
+    printf("Enter supervisor feedback for the case:\n");
+    clear_input_buffer();
+    char feedback[500];
+    fgets(feedback, sizeof(feedback), stdin);
+    feedback[strcspn(feedback, "\n")] = '\0';
+    m.feedback = feedback;
+    
+    printf("Enter clinical rating (0.0 - 5.0): ");
+    scanf("%f", &m.rating);
+    commit_mutation(&m);
+    
+    printf("\nCase evaluation completed successfully.\n");
+}
+
+void view_case_details(int case_index) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    print_menu_header("Case Details");
+    
+    printf("Case ID: %d\n", c->id);
+    printf("Patient ID: %d\n", c->patient_id);
+    printf("Therapist ID: %d\n", c->therapist_id);
+    printf("Supervisor ID: %d\n", c->supervisor_id);
+    printf("Status: %s\n", case_status_names[c->status]);
+    printf("Start Date: %s\n", date_text(c->start_date).text);
+    if (c->end_date != NO_DATE) printf("End Date: %s\n", date_text(c->end_date).text);
+    printf("Goals: %d\n", c->goal_count);
+    printf("Sessions: %d\n", session_total(c));
+    printf("Clinical Rating: %.1f/5.0\n", c->clinical_rating);
+    
+    int last_index = session_last(c);
+    if (last_index != NO_SESSION) {
+        TherapySession *last = session_at(last_index);
+        printf("Last Session: %s\n", date_text(last->date).text);
+        if (last->supervisor_reviewed) {
+            printf("Last Supervisor Review: Completed\n");
+        } else {
+            printf("Last Supervisor Review: Pending\n");
+        }
+    }
+}
+
+void print_case_row(int slot, void *ctx) {
+    (void)ctx;
+    TherapyCase *c = case_at(slot);
+    char patient_name[sizeof(((Patient *)0)->name)] = "Unknown";
+    Patient *p = find_patient(c->patient_id);
+    if (p != NULL) snprintf(patient_name, sizeof(patient_name), "%s", p->name);
+    
+    printf("%d\t%.15s\t%d\t\t%d\t\t%s\n", 
+          c->id, patient_name, c->therapist_id, 
+          c->session_count, case_status_names[c->status]);
+}
+
+static void *text_grow(void *items, uint32_t *capacity, uint32_t needed, size_t size) {
+    if (needed <= *capacity) return items;
+    uint32_t cap = *capacity ? *capacity : 16;
+    while (cap < needed) cap *= 2;
+    void *grown = realloc(items, (size_t)cap * size);
+    if (grown == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    *capacity = cap;
+    return grown;
+}
+
+uint32_t text_hash(const char *term, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)term[i]) * 16777619u;
+    return h;
+}
+
+static inline const char *text_term_name(const TextTerm *t) {
+    return text_term_chars + t->text;
+}
+
+// Returns the term id, or -1 if the term is unknown and create is false.
+int text_term_find(const char *term, size_t len, bool create) {
+    if (text_table_capacity == 0) {
+        if (!create) return -1;
+        text_table_capacity = 1024;
+        text_term_table = calloc(text_table_capacity, sizeof(uint32_t));
+        if (text_term_table == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+    }
+    
+    uint32_t mask = text_table_capacity - 1;
+    uint32_t h = text_hash(term, len) & mask;
+    while (text_term_table[h] != 0) {
+        const TextTerm *t = &text_terms[text_term_table[h] - 1];
+        const char *name = text_term_name(t);
+        if (strncmp(name, term, len) == 0 && name[len] == '\0') return text_term_table[h] - 1;
+        h = (h + 1) & mask;
+    }
+    if (!create) return -1;
+    
+    if ((text_term_count + 1) * 4 > text_table_capacity * 3) {
+        uint32_t capacity = text_table_capacity * 2;
+        uint32_t *table = calloc(capacity, sizeof(uint32_t));
+        if (table == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        for (uint32_t i = 0; i < text_term_count; i++) {
+            const char *name = text_term_name(&text_terms[i]);
+            uint32_t j = text_hash(name, strlen(name)) & (capacity - 1);
+            while (table[j] != 0) j = (j + 1) & (capacity - 1);
+            table[j] = i + 1;
+        }
+        free(text_term_table);
+        text_term_table = table;
+        text_table_capacity = capacity;
+        mask = capacity - 1;
+        h = text_hash(term, len) & mask;
+        while (text_term_table[h] != 0) h = (h + 1) & mask;
+    }
+    
+    if (text_term_chars_used + len + 1 > text_term_chars_capacity) {
+        size_t capacity = text_term_chars_capacity ? text_term_chars_capacity * 2 : 64 * 1024;
+        char *chars = realloc(text_term_chars, capacity);
+        if (chars == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        text_term_chars = chars;
+        text_term_chars_capacity = capacity;
+    }
+    text_terms = text_grow(text_terms, &text_term_capacity, text_term_count + 1, sizeof(TextTerm));
+    TextTerm *t = &text_terms[text_term_count];
+    memset(t, 0, sizeof(*t));
+    t->text = text_term_chars_used;
+    memcpy(text_term_chars + text_term_chars_used, term, len);
+    text_term_chars[text_term_chars_used + len] = '\0';
+    text_term_chars_used += len + 1;
+    text_term_table[h] = ++text_term_count;
+    return text_term_count - 1;
+}
+
+// Splits text into lowercase alphanumeric terms, calling emit with each
+// term and its position. Terms longer than TEXT_MAX_TERM are truncated.
+int text_tokenize(const char *text, void (*emit)(const char *term, size_t len, uint32_t pos, void *ctx), void *ctx) {
+    char term[TEXT_MAX_TERM];
+    size_t len = 0;
+    int pos = 0;
+    for (const char *c = text; ; c++) {
+        if (*c != '\0' && isalnum((unsigned char)*c)) {
+            if (len < TEXT_MAX_TERM) term[len++] = tolower((unsigned char)*c);
+            continue;
+        }
+        if (len > 0) {
+            emit(term, len, pos++, ctx);
+            len = 0;
+        }
+        if (*c == '\0') return pos;
+    }
+}
+
+static void text_add_posting(const char *term, size_t len, uint32_t pos, void *ctx) {
+    uint32_t doc = *(uint32_t *)ctx;
+    int id = text_term_find(term, len, true);
+    TextTerm *t = &text_terms[id];
+    if (t->count == 0 || t->postings[t->count - 1].doc != doc) t->doc_count++;
+    t->postings = text_grow(t->postings, &t->capacity, t->count + 1, sizeof(TextPosting));
+    t->postings[t->count].doc = doc;
+    t->postings[t->count].pos = pos;
+    t->count++;
+}
+
+static void text_index_doc(StrRef ref, int owner) {
+    char text[STR_MAX_LEN + 1];
+    uint32_t doc = text_doc_count;
+    text_docs = text_grow(text_docs, &text_doc_capacity, doc + 1, sizeof(TextDoc));
+    text_docs[doc].ref = ref;
+    text_docs[doc].owner = owner;
+    text_docs[doc].length = text_tokenize(str_get(ref, text, sizeof(text)), text_add_posting, &doc);
+    text_total_length += text_docs[doc].length;
+    text_doc_count++;
+}
+
+// The string currently held by the field a document was indexed from.
+StrRef text_owner_ref(int owner) {
+    int value = owner & ((1 << TEXT_OWNER_SHIFT) - 1);
+    int sessions = __atomic_load_n(&session_log_count, __ATOMIC_RELAXED);
+    switch (owner >> TEXT_OWNER_SHIFT) {
+        case TEXT_DIAGNOSIS:
+            return value < patient_count ? patient_at(value)->diagnosis : 0;
+        case TEXT_GOAL:
+            return value / MAX_GOALS < case_count ? case_goals(value / MAX_GOALS)[value % MAX_GOALS].description : 0;
+        case TEXT_ACTIVITIES:
+            return value < sessions ? session_at(value)->activities : 0;
+        case TEXT_OBSERVATIONS:
+            return value < sessions ? session_at(value)->observations : 0;
+        case TEXT_FEEDBACK:
+            return value < sessions ? session_at(value)->supervisor_feedback : 0;
+        default:
+            return 0;
+    }
+}
+
+static int compare_text_docs(const void *a, const void *b) {
+    StrRef x = ((const TextDoc *)a)->ref, y = ((const TextDoc *)b)->ref;
+    return x < y ? -1 : x > y;
+}
+
+// Built on first search. Current strings are indexed in heap order; after
+// that every new string is appended by the mutation that stores it.
+void ensure_text_index() {
+    if (text_index_ready) return;
+    text_index_ready = true;
+    
+    TextDoc *pending = NULL;
+    uint32_t count = 0, capacity = 0;
+    #define TEXT_PENDING(r, o) do { \
+        if ((r) != 0) { \
+            pending = text_grow(pending, &capacity, count + 1, sizeof(TextDoc)); \
+            pending[count].ref = (r); \
+            pending[count++].owner = (o); \
+        } \
+    } while (0)
+    for (int i = 0; i < patient_count; i++) {
+        TEXT_PENDING(patient_at(i)->diagnosis, TEXT_OWNER(TEXT_DIAGNOSIS, i));
+    }
+    for (int i = 0; i < case_count; i++) {
+        TherapyCase *c = case_at(i);
+        for (int g = 0; g < c->goal_count && g < MAX_GOALS; g++) {
+            TEXT_PENDING(case_goals(i)[g].description, TEXT_OWNER(TEXT_GOAL, i * MAX_GOALS + g));
+        }
+    }
+    for (int i = 0; i < session_log_count; i++) {
+        TherapySession *s = session_at(i);
+        TEXT_PENDING(s->activities, TEXT_OWNER(TEXT_ACTIVITIES, i));
+        TEXT_PENDING(s->observations, TEXT_OWNER(TEXT_OBSERVATIONS, i));
+        TEXT_PENDING(s->supervisor_feedback, TEXT_OWNER(TEXT_FEEDBACK, i));
+    }
+    #undef TEXT_PENDING
+    
+    qsort(pending, count, sizeof(TextDoc), compare_text_docs);
+    for (uint32_t i = 0; i < count; i++) text_index_doc(pending[i].ref, pending[i].owner);
+    free(pending);
+}
+
+void text_index_add(StrRef ref, int owner) {
+    if (!text_index_ready || ref == 0) return;
+    pthread_rwlock_wrlock(&text_index_lock);
+    text_index_doc(ref, owner);
+    pthread_rwlock_unlock(&text_index_lock);
+}
+
+static void hits_add(TextHits *hits, uint32_t doc, float score) {
+    if (hits->count > 0 && hits->items[hits->count - 1].doc == doc) {
+        hits->items[hits->count - 1].score += score;
+        return;
+    }
+    uint32_t capacity = hits->capacity;
+    hits->items = text_grow(hits->items, &capacity, hits->count + 1, sizeof(TextHit));
+    hits->capacity = capacity;
+    hits->items[hits->count].doc = doc;
+    hits->items[hits->count++].score = score;
+}
+
+// BM25 weight of a term occurring tf times in a document.
+static float text_weight(uint32_t doc_count, uint32_t tf, uint32_t doc) {
+    const float k1 = 1.2f, b = 0.75f;
+    float avg = text_doc_count ? (float)text_total_length / text_doc_count : 1.0f;
+    float idf = logf(1.0f + (text_doc_count - doc_count + 0.5f) / (doc_count + 0.5f));
+    float norm = k1 * (1.0f - b + b * text_docs[doc].length / (avg > 0 ? avg : 1.0f));
+    return idf * tf * (k1 + 1.0f) / (tf + norm);
+}
+
+static void term_hits(const TextTerm *t, TextHits *hits) {
+    for (uint32_t i = 0; i < t->count; ) {
+        uint32_t doc = t->postings[i].doc, tf = 0;
+        while (i < t->count && t->postings[i].doc == doc) i++, tf++;
+        hits_add(hits, doc, text_weight(t->doc_count, tf, doc));
+    }
+}
+
+static int compare_hit_doc(const void *a, const void *b) {
+    uint32_t x = ((const TextHit *)a)->doc, y = ((const TextHit *)b)->doc;
+    return x < y ? -1 : x > y;
+}
+
+// Every term starting with the prefix contributes; the dictionary scan is
+// linear in the number of distinct terms, not in the number of documents.
+static void prefix_hits(const char *prefix, size_t len, TextHits *hits) {
+    TextHits all = { 0 };
+    for (uint32_t i = 0; i < text_term_count; i++) {
+        if (strncmp(text_term_name(&text_terms[i]), prefix, len) == 0) term_hits(&text_terms[i], &all);
+    }
+    qsort(all.items, all.count, sizeof(TextHit), compare_hit_doc);
+    for (int i = 0; i < all.count; i++) hits_add(hits, all.items[i].doc, all.items[i].score);
+    free(all.items);
+}
+
+// First posting of doc (or later) in a term's list.
+static uint32_t posting_seek(const TextTerm *t, uint32_t from, uint32_t doc) {
+    uint32_t lo = from, hi = t->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (t->postings[mid].doc < doc) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void phrase_hits(const int *terms, int n, TextHits *hits) {
+    const TextTerm *first = &text_terms[terms[0]];
+    uint32_t cursor[TEXT_MAX_TERM] = { 0 };
+    
+    for (uint32_t i = 0; i < first->count; ) {
+        uint32_t doc = first->postings[i].doc, end = i;
+        while (end < first->count && first->postings[end].doc == doc) end++;
+        
+        bool present = true;
+        for (int k = 1; k < n && present; k++) {
+            const TextTerm *t = &text_terms[terms[k]];
+            cursor[k] = posting_seek(t, cursor[k], doc);
+            present = cursor[k] < t->count && t->postings[cursor[k]].doc == doc;
+        }
+        
+        uint32_t tf = 0;
+        for (uint32_t p = i; present && p < end; p++) {
+            uint32_t pos = first->postings[p].pos;
+            bool match = true;
+            for (int k = 1; k < n && match; k++) {
+                const TextTerm *t = &text_terms[terms[k]];
+                match = false;
+                for (uint32_t q = cursor[k]; q < t->count && t->postings[q].doc == doc; q++) {
+                    if (t->postings[q].pos == pos + k) match = true;
+                    if (t->postings[q].pos >= pos + k) break;
+                }
+            }
+            if (match) tf++;
+        }
+        if (tf > 0) {
+            float score = 0;
+            for (int k = 0; k < n; k++) score += text_weight(text_terms[terms[k]].doc_count, tf, doc);
+            hits_add(hits, doc, score);
+        }
+        i = end;
+    }
+}
+
+// Keeps the documents present in both lists, summing their scores.
+static void hits_intersect(TextHits *into, const TextHits *other) {
+    int n = 0;
+    for (int i = 0, j = 0; i < into->count && j < other->count; ) {
+        if (into->items[i].doc < other->items[j].doc) i++;
+        else if (into->items[i].doc > other->items[j].doc) j++;
+        else {
+            into->items[n] = into->items[i];
+            into->items[n++].score += other->items[j].score;
+            i++, j++;
+        }
+    }
+    into->count = n;
+}
+
+typedef struct {
+    int terms[TEXT_MAX_TERM];
+    int count;
+    bool missing;
+} PhraseTerms;
+
+static void phrase_collect(const char *term, size_t len, uint32_t pos, void *ctx) {
+    (void)pos;
+    PhraseTerms *phrase = ctx;
+    int id = text_term_find(term, len, false);
+    METRIC_ADD(id < 0 ? MC_TEXT_TERM_MISSES : MC_TEXT_TERM_HITS, 1);
+    if (id < 0) phrase->missing = true;
+    else if (phrase->count < TEXT_MAX_TERM) phrase->terms[phrase->count++] = id;
+}
+
+// Query syntax: words are ANDed, "quoted words" must appear as a phrase and
+// a trailing * makes a word a prefix. All parts must match in one field.
+// Emits at most TEXT_MAX_RESULTS documents, best first, and returns the
+// total number of matching documents.
+int text_search(const char *query, void (*emit)(uint32_t doc, float score, void *ctx), void *ctx) {
+    METRIC_SCOPE(OP_TEXT_SEARCH);
+    ensure_text_index();
+    // Held through emit too, which looks documents up in text_docs.
+    pthread_rwlock_rdlock(&text_index_lock);
+    
+    TextHits result = { 0 };
+    bool first = true;
+    const char *c = query;
+    while (*c) {
+        while (*c && !isalnum((unsigned char)*c) && *c != '"') c++;
+        if (*c == '\0') break;
+        
+        TextHits clause = { 0 };
+        if (*c == '"') {
+            const char *end = strchr(c + 1, '"');
+            size_t len = end ? (size_t)(end - c - 1) : strlen(c + 1);
+            char *text = malloc(len + 1);
+            if (text == NULL) {
+                printf("Out of memory.\n");
+                exit(1);
+            }
+            memcpy(text, c + 1, len);
+            text[len] = '\0';
+            PhraseTerms phrase = { .count = 0 };
+            text_tokenize(text, phrase_collect, &phrase);
+            free(text);
+            if (!phrase.missing && phrase.count > 0) phrase_hits(phrase.terms, phrase.count, &clause);
+            c = end ? end + 1 : c + 1 + len;
+            if (phrase.count == 0 && !phrase.missing) continue;
+        } else {
+            char term[TEXT_MAX_TERM];
+            size_t len = 0;
+            while (*c && isalnum((unsigned char)*c)) {
+                if (len < TEXT_MAX_TERM) term[len++] = tolower((unsigned char)*c);
+                c++;
+            }
+            if (*c == '*') {
+                prefix_hits(term, len, &clause);
+                c++;
+            } else {
+                int id = text_term_find(term, len, false);
+                METRIC_ADD(id < 0 ? MC_TEXT_TERM_MISSES : MC_TEXT_TERM_HITS, 1);
+                if (id >= 0) term_hits(&text_terms[id], &clause);
+            }
+        }
+        
+        if (first) {
+            result = clause;
+            first = false;
+        } else {
+            hits_intersect(&result, &clause);
+            free(clause.items);
+        }
+        if (result.count == 0) break;
+    }
+    
+    // Top results by score; stale documents (rewritten goals and feedback)
+    // are dropped here rather than removed from the postings.
+    TextHit top[TEXT_MAX_RESULTS];
+    int top_count = 0, matches = 0;
+    for (int i = 0; i < result.count; i++) {
+        const TextHit *h = &result.items[i];
+        if (text_owner_ref(text_docs[h->doc].owner) != text_docs[h->doc].ref) continue;
+        matches++;
+        if (top_count == TEXT_MAX_RESULTS && h->score <= top[top_count - 1].score) continue;
+        int j = top_count < TEXT_MAX_RESULTS ? top_count++ : top_count - 1;
+        while (j > 0 && top[j - 1].score < h->score) {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = *h;
+    }
+    free(result.items);
+    
+    for (int i = 0; i < top_count; i++) emit(top[i].doc, top[i].score, ctx);
+    pthread_rwlock_unlock(&text_index_lock);
+    return matches;
+}
+
+// Describes where a document came from: returns its case id, and sets
+// the field name and a short location such as the session date.
+int text_hit_location(uint32_t doc, const char **field, char *where, size_t size) {
+    static const char *fields[] = { "", "Diagnosis", "Goal", "Activities", "Observations", "Feedback" };
+    int owner = text_docs[doc].owner;
+    int kind = owner >> TEXT_OWNER_SHIFT;
+    int value = owner & ((1 << TEXT_OWNER_SHIFT) - 1);
+    
+    int case_id = 0;
+    *field = fields[kind];
+    where[0] = '\0';
+    if (kind == TEXT_DIAGNOSIS) {
+        CaseList *cases = posting_get(&cases_by_patient, patient_at(value)->id);
+        if (cases != NULL && cases->count > 0) case_id = case_at(cases->items[0])->id;
+    } else if (kind == TEXT_GOAL) {
+        case_id = case_at(value / MAX_GOALS)->id;
+        snprintf(where, size, "goal %d", value % MAX_GOALS + 1);
+    } else {
+        case_id = session_at(value)->case_id;
+        snprintf(where, size, "session %s", date_text(session_at(value)->date).text);
+    }
+    return case_id;
+}
+
+void print_text_hit(uint32_t doc, float score, void *ctx) {
+    (void)ctx;
+    const char *field;
+    char where[32];
+    char preview[61];
+    int case_id = text_hit_location(doc, &field, where, sizeof(where));
+    printf("%d\t%-12s\t%-18s\t%.2f\t%.60s\n", case_id, field, where, score,
+           str_get(text_docs[doc].ref, preview, sizeof(preview)));
+}
+
+static void date_run_reserve(SessionDateRun *run, int needed) {
+    if (needed <= run->capacity) return;
+    int capacity = run->capacity ? run->capacity * 2 : 1024;
+    while (capacity < needed) capacity *= 2;
+    SessionDateEntry *items = realloc(run->items, capacity * sizeof(SessionDateEntry));
+    if (items == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    run->items = items;
+    run->capacity = capacity;
+}
+
+static inline bool date_entry_before(const SessionDateEntry *a, const SessionDateEntry *b) {
+    return a->date < b->date || (a->date == b->date && a->session < b->session);
+}
+
+static int compare_date_entries(const void *a, const void *b) {
+    const SessionDateEntry *x = a, *y = b;
+    return date_entry_before(x, y) ? -1 : date_entry_before(y, x);
+}
+
+// First entry of the run dated on or after date.
+static int date_run_seek(const SessionDateRun *run, Date date) {
+    int lo = 0, hi = run->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (run->items[mid].date < date) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void date_index_merge_late() {
+    SessionDateRun *main = &sessions_by_date, *late = &sessions_by_date_late;
+    date_run_reserve(main, main->count + late->count);
+    int i = main->count - 1, j = late->count - 1, k = main->count + late->count - 1;
+    while (j >= 0) {
+        if (i >= 0 && date_entry_before(&late->items[j], &main->items[i])) main->items[k--] = main->items[i--];
+        else main->items[k--] = late->items[j--];
+    }
+    main->count += late->count;
+    late->count = 0;
+}
+
+// Built on first use from the session log.
+void ensure_date_index() {
+    if (date_index_ready) return;
+    date_index_ready = true;
+    
+    SessionDateRun *main = &sessions_by_date;
+    date_run_reserve(main, session_log_count);
+    bool sorted = true;
+    for (int i = 0; i < session_log_count; i++) {
+        const TherapySession *s = session_at(i);
+        int slot = s->case_id - 1;
+        if (slot < 0 || slot >= case_count || case_at(slot)->id != s->case_id) slot = find_case(s->case_id);
+        SessionDateEntry *e = &main->items[main->count++];
+        e->date = s->date;
+        e->case_slot = slot;
+        e->session = i;
+        if (main->count > 1 && date_entry_before(e, e - 1)) sorted = false;
+    }
+    if (!sorted) qsort(main->items, main->count, sizeof(SessionDateEntry), compare_date_entries);
+}
+
+// Sessions are usually recorded in date order and go straight onto the
+// end of the main run; back-dated ones wait in the late run.
+void date_index_add(Date date, int case_slot, int session) {
+    if (!date_index_ready) return;
+    SessionDateEntry e = { date, case_slot, session };
+    SessionDateRun *main = &sessions_by_date, *late = &sessions_by_date_late;
+    
+    pthread_rwlock_wrlock(&date_index_lock);
+    if (late->count == 0 && (main->count == 0 || !date_entry_before(&e, &main->items[main->count - 1]))) {
+        date_run_reserve(main, main->count + 1);
+        main->items[main->count++] = e;
+    } else {
+        date_run_reserve(late, late->count + 1);
+        int pos = late->count;
+        while (pos > 0 && date_entry_before(&e, &late->items[pos - 1])) pos--;
+        memmove(&late->items[pos + 1], &late->items[pos], (late->count - pos) * sizeof(SessionDateEntry));
+        late->items[pos] = e;
+        late->count++;
+        if (late->count >= DATE_INDEX_RUN_MAX) date_index_merge_late();
+    }
+    pthread_rwlock_unlock(&date_index_lock);
+}
+
+// Emits every session dated from..to (inclusive, NO_DATE for open ends)
+// in date order and returns how many there were.
+int sessions_in_range(Date from, Date to, void (*emit)(const SessionDateEntry *e, void *ctx), void *ctx) {
+    METRIC_SCOPE(OP_SESSIONS_IN_RANGE);
+    ensure_date_index();
+    const SessionDateRun *main = &sessions_by_date, *late = &sessions_by_date_late;
+    if (to == NO_DATE) to = INT32_MAX;
+    pthread_rwlock_rdlock(&date_index_lock);
+    
+    int i = date_run_seek(main, from), j = date_run_seek(late, from), n = 0;
+    while (1) {
+        bool has_main = i < main->count && main->items[i].date <= to;
+        bool has_late = j < late->count && late->items[j].date <= to;
+        if (!has_main && !has_late) break;
+        if (has_main && (!has_late || !date_entry_before(&late->items[j], &main->items[i]))) {
+            emit(&main->items[i++], ctx);
+        } else {
+            emit(&late->items[j++], ctx);
+        }
+        n++;
+    }
+    pthread_rwlock_unlock(&date_index_lock);
+    return n;
+}
+
+// ctx is a SessionFilter; rows that pass it are printed and counted.
+void print_session_row(const SessionDateEntry *e, void *ctx) {
+    SessionFilter *f = ctx;
+    if (e->case_slot < 0) return;
+    const TherapyCase *c = case_at(e->case_slot);
+    const TherapySession *s = session_at(e->session);
+    if (f->therapist_id && c->therapist_id != f->therapist_id) return;
+    if (f->supervisor_id && c->supervisor_id != f->supervisor_id) return;
+    if (f->unreviewed_only && s->supervisor_reviewed) return;
+    char preview[41];
+    
+    printf("%s\t%d\t%d\t%d\t\t%s\t%.40s\n", date_text(e->date).text, c->id, s->session_id,
+           c->therapist_id, s->supervisor_reviewed ? "Yes" : "No",
+           str_get(s->activities, preview, sizeof(preview)));
+    f->count++;
+}
+
+void print_sessions_in_range(SessionFilter *filter, Date from, Date to) {
+    printf("\nDate\t\tCase\tSession\tTherapist\tReviewed\tActivities\n");
+    printf("--------------------------------------------------------------------------\n");
+    filter->count = 0;
+    sessions_in_range(from, to, print_session_row, filter);
+    printf("%d session(s).\n", filter->count);
+}
+
+// A case is waiting for review while it is active, has enough sessions
+// to be evaluated and its latest session has not been reviewed yet.
+static bool needs_review(const TherapyCase *c) {
+    int last = session_last(c);
+    return c->is_active && session_total(c) >= EVALUATION_MIN_SESSIONS &&
+           last != NO_SESSION && !session_at(last)->supervisor_reviewed;
+}
+
+static ReviewQueue *review_queue_for(int supervisor_id, bool create) {
+    int n = id_index_get(&review_queue_keys, supervisor_id);
+    if (n >= 0) return &review_queues[n];
+    if (!create) return NULL;
+    
+    if (review_queue_count == review_queue_capacity) {
+        int capacity = review_queue_capacity ? review_queue_capacity * 2 : 16;
+        ReviewQueue *queues = realloc(review_queues, capacity * sizeof(ReviewQueue));
+        if (queues == NULL) {
+            printf("Out of memory.\n");
+            exit(1);
+        }
+        review_queues = queues;
+        review_queue_capacity = capacity;
+    }
+    n = review_queue_count++;
+    review_queues[n].head = review_queues[n].tail = -1;
+    review_queues[n].count = 0;
+    id_index_put(&review_queue_keys, supervisor_id, n);
+    return &review_queues[n];
+}
+
+static void review_links_reserve(int count) {
+    if (count <= review_link_capacity) return;
+    int capacity = review_link_capacity ? review_link_capacity * 2 : 1024;
+    while (capacity < count) capacity *= 2;
+    ReviewLink *links = realloc(review_links, capacity * sizeof(ReviewLink));
+    if (links == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    memset(links + review_link_capacity, 0, (capacity - review_link_capacity) * sizeof(ReviewLink));
+    review_links = links;
+    review_link_capacity = capacity;
+}
+
+static void review_enqueue(int slot) {
+    ReviewQueue *q = review_queue_for(case_at(slot)->supervisor_id, true);
+    ReviewLink *link = &review_links[slot];
+    link->prev = q->tail;
+    link->next = -1;
+    link->queued = true;
+    if (q->tail >= 0) review_links[q->tail].next = slot;
+    else q->head = slot;
+    q->tail = slot;
+    q->count++;
+}
+
+static void review_dequeue(int slot) {
+    ReviewQueue *q = review_queue_for(case_at(slot)->supervisor_id, false);
+    ReviewLink *link = &review_links[slot];
+    if (link->prev >= 0) review_links[link->prev].next = link->next;
+    else q->head = link->next;
+    if (link->next >= 0) review_links[link->next].prev = link->prev;
+    else q->tail = link->prev;
+    link->queued = false;
+    q->count--;
+}
+
+static int compare_last_session(const void *a, const void *b) {
+    int x = case_at(*(const int *)a)->last_session, y = case_at(*(const int *)b)->last_session;
+    return x < y ? -1 : x > y;
+}
+
+// Built on first use. Cases that are already waiting are queued in the
+// order of their latest session, so the longest waiting comes first.
+void ensure_review_queues() {
+    if (review_queues_ready) return;
+    review_queues_ready = true;
+    review_links_reserve(case_count);
+    
+    CaseList waiting = { 0 };
+    for (int i = 0; i < case_count; i++) {
+        if (needs_review(case_at(i))) case_list_add(&waiting, i);
+    }
+    qsort(waiting.items, waiting.count, sizeof(int), compare_last_session);
+    for (int k = 0; k < waiting.count; k++) review_enqueue(waiting.items[k]);
+    free(waiting.items);
+}
+
+// Called after every change to a case that can affect whether it waits
+// for review: a new session, an evaluation or closing the case.
+// Concurrent appends to one case each re-check it under review_lock, so
+// the last of them leaves it queued or not as its final state requires.
+void review_update(int slot) {
+    if (!review_queues_ready) return;
+    pthread_mutex_lock(&review_lock);
+    review_links_reserve(slot + 1);
+    bool waiting = needs_review(case_at(slot));
+    if (waiting && !review_links[slot].queued) review_enqueue(slot);
+    else if (!waiting && review_links[slot].queued) review_dequeue(slot);
+    pthread_mutex_unlock(&review_lock);
+}
+
+int review_pending(int supervisor_id) {
+    ensure_review_queues();
+    pthread_mutex_lock(&review_lock);
+    ReviewQueue *q = review_queue_for(supervisor_id, false);
+    int count = q ? q->count : 0;
+    pthread_mutex_unlock(&review_lock);
+    return count;
+}
+
+// Slot of the case that has waited longest, or -1.
+int review_next(int supervisor_id) {
+    ensure_review_queues();
+    pthread_mutex_lock(&review_lock);
+    ReviewQueue *q = review_queue_for(supervisor_id, false);
+    int slot = q ? q->head : -1;
+    pthread_mutex_unlock(&review_lock);
+    return slot;
+}
+
+// Copies up to max waiting slots, longest waiting first, and returns how
+// many cases are waiting in all.
+int review_list(int supervisor_id, int *slots, int max) {
+    ensure_review_queues();
+    pthread_mutex_lock(&review_lock);
+    ReviewQueue *q = review_queue_for(supervisor_id, false);
+    int count = q ? q->count : 0;
+    for (int i = q ? q->head : -1, k = 0; i >= 0 && k < max; i = review_links[i].next, k++) slots[k] = i;
+    pthread_mutex_unlock(&review_lock);
+    return count;
+}
+
+void search_cases() {
+    METRIC_SCOPE(OP_SEARCH_MENU);
+    print_menu_header("Search Cases");
+    
+    printf("Search by:\n");
+    printf("1. Patient ID\n");
+    printf("2. Therapist ID\n");
+    printf("3. Supervisor ID\n");
+    printf("4. Status\n");
+    printf("5. Show All\n");
+    printf("6. Combined Filter\n");
+    printf("7. Full-Text Search (clinical notes)\n");
+    printf("Choice: ");
+    
+    int choice;
+    scanf("%d", &choice);
+    
+    CaseQuery q = { 0 };
+    char status[20];
+    
+    switch(choice) {
+        case 1:
+            printf("Enter Patient ID: ");
+            scanf("%d", &q.patient_id);
+            if (q.patient_id == 0) q.patient_id = -1;
+            break;
+        case 2:
+            printf("Enter Therapist ID: ");
+            scanf("%d", &q.therapist_id);
+            if (q.therapist_id == 0) q.therapist_id = -1;
+            break;
+        case 3:
+            printf("Enter Supervisor ID: ");
+            scanf("%d", &q.supervisor_id);
+            if (q.supervisor_id == 0) q.supervisor_id = -1;
+            break;
+        case 4:
+            printf("Enter Status: ");
+            scanf("%19s", status);
+            if (!parse_case_status(status, &q.status)) {
+                print_status_choices();
+                return;
+            }
+            break;
+        case 5:
+            break;
+        case 6:
+            printf("Therapist ID (0 for any): ");
+            scanf("%d", &q.therapist_id);
+            printf("Supervisor ID (0 for any): ");
+            scanf("%d", &q.supervisor_id);
+            printf("Status (or 'any'): ");
+            scanf("%19s", status);
+            if (!parse_status_filter(status, &q.status)) {
+                print_status_choices();
+                return;
+            }
+            printf("Minimum sessions: ");
+            scanf("%d", &q.min_sessions);
+            break;
+        case 7: {
+            char text[256];
+            printf("Search terms (\"phrase\", prefix*): ");
+            clear_input_buffer();
+            if (fgets(text, sizeof(text), stdin) == NULL) return;
+            text[strcspn(text, "\n")] = '\0';
+            
+            printf("\nSearch Results:\n");
+            printf("Case\tField\t\tWhere\t\t\tScore\tText\n");
+            printf("------------------------------------------------\n");
+            int matches = text_search(text, print_text_hit, NULL);
+            printf("%d matching entr%s.\n", matches, matches == 1 ? "y" : "ies");
+            return;
+        }
+        default:
+            printf("Invalid choice.\n");
+            return;
+    }
+    
+    printf("\nSearch Results:\n");
+    printf("ID\tPatient\tTherapist\tSessions\tStatus\n");
+    printf("------------------------------------------------\n");
+    
+    int matches = query_cases(&q, print_case_row, NULL);
+    printf("%d case(s) found.\n", matches);
+}
+
+void close_case(int case_index) {
+    if (case_index < 0 || case_index >= case_count) {
+        printf("Invalid case index.\n");
+        return;
+    }
+    
+    TherapyCase *c = case_at(case_index);
+    if (!c->is_active) {
+        printf("Case is already closed.\n");
+        return;
+    }
+    
+    Mutation m = { MUT_CLOSE };
+    m.case_id = c->id;
+    printf("Enter end date (YYYY-MM-DD): ");
+    m.date = read_date();
+    
+    printf("Enter status (Completed/Discontinued/Discharged): ");
+    char status[20];
+    scanf("%19s", status);
+    while (!parse_case_status(status, &m.status) || m.status == CASE_ACTIVE) {
+        printf("Invalid status. Enter Completed, Discontinued, Discharged or Closed: ");
+        scanf("%19s", status);
+    }
+    
+    printf("Final clinical rating (0.0-5.0): ");
+    scanf("%f", &m.rating);
+    
+    commit_mutation(&m);
+    
+    printf("\nCase %d closed successfully.\n", c->id);
+}
+
+void therapist_dashboard(int therapist_id) {
+    Therapist *t = find_therapist(therapist_id);
+    
+    if (t == NULL) {
+        printf("Therapist not found.\n");
+        return;
+    }
+    
+    int choice;
+    
+    while(1) {
+        print_menu_header("Therapist Dashboard");
+        printf("Welcome, %s (%s)\n", t->name, t->specialization);
+        printf("Current cases: %d\n\n", t->current_cases);
+        
+        printf("1. View My Cases\n");
+        printf("2. Record Session\n");
+        printf("3. Create/Modify Therapy Plan\n");
+        printf("4. Generate Progress Report\n");
+        printf("5. Sessions by Date Range\n");
+        printf("6. Return to Main Menu\n");
+        printf("Choice: ");
+        scanf("%d", &choice);
+        // Covers handling the choice, including any prompts it shows.
+        METRIC_SCOPE(OP_THERAPIST_MENU);
+        
+        switch(choice) {
+            case 1: {
+                printf("\nYour Active Cases:\n");
+                printf("ID\tPatient\tSessions\n");
+                printf("------------------------\n");
+                CaseList *mine = posting_get(&cases_by_therapist, therapist_id);
+                for (int k = 0; mine != NULL && k < mine->count; k++) {
+                    int i = mine->items[k];
+                    if (case_at(i)->is_active) {
+                        char patient_name[sizeof(((Patient *)0)->name)] = "Unknown";
+                        Patient *p = find_patient(case_at(i)->patient_id);
+                        if (p != NULL) snprintf(patient_name, sizeof(patient_name), "%s", p->name);
+                        printf("%d\t%.15s\t%d\n", case_at(i)->id, patient_name, case_at(i)->session_count);
+                    }
+                }
+                break;
+            }
+            case 2: {
+                printf("Enter Case ID to record session: ");
+                int case_id;
+                scanf("%d", &case_id);
+                int i = find_case(case_id);
+                if (i >= 0 && case_at(i)->therapist_id == therapist_id) {
+                    record_session(i);
+                } else {
+                    printf("Case not found or not assigned to you.\n");
+                }
+                break;
+            }
+            case 3: {
+                printf("Enter Case ID to modify plan: ");
+                int case_id;
+                scanf("%d", &case_id);
+                int i = find_case(case_id);
+                if (i >= 0 && case_at(i)->therapist_id == therapist_id) {
+                    create_therapy_plan(i);
+                } else {
+                    printf("Case not found or not assigned to you.\n");
+                }
+                break;
+            }
+            case 4: {
+                printf("Enter Case ID to generate report: ");
+                int case_id;
+                scanf("%d", &case_id);
+                int i = find_case(case_id);
+                if (i >= 0 && case_at(i)->therapist_id == therapist_id) {
+                    generate_progress_report(i, false);
+                } else {
+                    printf("Case not found or not assigned to you.\n");
+                }
+                break;
+            }
+            case 5: {
+                SessionFilter filter = { therapist_id, 0, false, 0 };
+                printf("From date (YYYY-MM-DD): ");
+                Date from = read_date();
+                printf("To date (YYYY-MM-DD): ");
+                Date to = read_date();
+                print_sessions_in_range(&filter, from, to);
+                break;
+            }
+            case 6:
+                return;
+            default:
                 printf("Invalid choice.\n");
+        }
+    }
+}
+
+void supervisor_dashboard(int supervisor_id) {
+    Supervisor *s = find_supervisor(supervisor_id);
+    
+    if (s == NULL) {
+        printf("Supervisor not found.\n");
+        return;
+    }
+    
+    int choice;
+    
+    while(1) {
+        print_menu_header("Supervisor Dashboard");
+        printf("Welcome, %s\n", s->name);
+        printf("Cases awaiting evaluation: %d\n\n", review_pending(supervisor_id));
+        
+        printf("1. View Cases Under Supervision\n");
+        printf("2. Review Therapy Plans\n");
+        printf("3. Evaluate Cases\n");
+        printf("4. Generate Reports\n");
+        printf("5. Export All Reports\n");
+        printf("6. Caseload Analytics\n");
+        printf("7. Sessions by Date Range\n");
+        printf("8. Return to Main Menu\n");
+        printf("Choice: ");
+        scanf("%d", &choice);
+        
+        METRIC_SCOPE(OP_SUPERVISOR_MENU);
+        CaseList *supervised = posting_get(&cases_by_supervisor, supervisor_id);
+        switch(choice) {
+            case 1: {
+                printf("\nCases Under Your Supervision:\n");
+                printf("ID\tPatient\tTherapist\tSessions\tStatus\n");
+                printf("-----------------------------------------------\n");
+                for (int k = 0; supervised != NULL && k < supervised->count; k++) {
+                    int i = supervised->items[k];
+                    char patient_name[sizeof(((Patient *)0)->name)] = "Unknown";
+                    Patient *p = find_patient(case_at(i)->patient_id);
+                    if (p != NULL) snprintf(patient_name, sizeof(patient_name), "%s", p->name);
+                        
+                    char therapist_name[sizeof(((Therapist *)0)->name)] = "Unknown";
+                    Therapist *t = find_therapist(case_at(i)->therapist_id);
+                    if (t != NULL) snprintf(therapist_name, sizeof(therapist_name), "%s", t->name);
+                        
+                    printf("%d\t%.15s\t%.15s\t%d\t\t%s\n", 
+                          case_at(i)->id, patient_name, therapist_name,
+                          case_at(i)->session_count, case_status_names[case_at(i)->status]);
+                }
+                break;
+            }
+            case 2: {
+                printf("\nCases Needing Plan Review:\n");
+                bool found = false;
+                for (int k = 0; supervised != NULL && k < supervised->count; k++) {
+                    int i = supervised->items[k];
+                    if (case_at(i)->session_count == 0) {
+                        printf("Case ID: %d | Patient ID: %d\n", 
+                              case_at(i)->id, case_at(i)->patient_id);
+                        found = true;
+                    }
+                }
+                if (!found) printf("No cases need plan review at this time.\n");
+                
+                printf("\nEnter Case ID to review plan (or 0 to cancel): ");
+                int case_id;
+                scanf("%d", &case_id);
+                if (case_id == 0) break;
+                
+                int i = find_case(case_id);
+                if (i >= 0 && case_at(i)->supervisor_id == supervisor_id) {
+                    view_case_details(i);
+                    printf("\n1. Approve Plan\n2. Request Changes\nChoice: ");
+                    int review_choice;
+                    scanf("%d", &review_choice);
+                    if (review_choice == 1) {
+                        printf("Plan approved. Therapist can now begin sessions.\n");
+                    } else {
+                        printf("Enter feedback for changes: ");
+                        clear_input_buffer();
+                        char feedback[500];
+                        fgets(feedback, sizeof(feedback), stdin);
+                        feedback[strcspn(feedback, "\n")] = '\0';
+                        printf("Feedback sent to therapist.\n");
+                    }
+                }
+                break;
+            }
+            case 3: {
+                int waiting[20];
+                int pending = review_list(supervisor_id, waiting, 20);
+                printf("\nCases Awaiting Evaluation (%d+ sessions, longest waiting first): %d\n",
+                       EVALUATION_MIN_SESSIONS, pending);
+                int shown = pending < 20 ? pending : 20;
+                for (int k = 0; k < shown; k++) {
+                    int i = waiting[k];
+                    printf("Case ID: %d | Sessions: %d | Last session: %s\n", case_at(i)->id,
+                           session_total(case_at(i)), date_text(session_at(session_last(case_at(i)))->date).text);
+                }
+                if (pending > shown) printf("... and %d more\n", pending - shown);
+                if (pending == 0) printf("No cases ready for evaluation at this time.\n");
+                
+                printf("\nEnter Case ID to evaluate (0 to cancel, -1 for the next in queue): ");
+                int case_id;
+                scanf("%d", &case_id);
+                if (case_id == 0) break;
+                
+                int i = case_id == -1 ? review_next(supervisor_id) : find_case(case_id);
+                if (i >= 0 && case_at(i)->supervisor_id == supervisor_id) {
+                    evaluate_case(i);
+                }
+                break;
+            }
+            case 4: {
+                printf("\nEnter Case ID to generate report: ");
+                int case_id;
+                scanf("%d", &case_id);
+                int i = find_case(case_id);
+                if (i >= 0 && case_at(i)->supervisor_id == supervisor_id) {
+                    generate_progress_report(i, true);
+                }
+                break;
+            }
+            case 5: {
+                ExportFilter filter = { { 0 } };
+                filter.query.supervisor_id = supervisor_id;
+                char status[20];
+                printf("\nTherapist ID (0 for any): ");
+                scanf("%d", &filter.query.therapist_id);
+                printf("Status (or 'any'): ");
+                scanf("%19s", status);
+                if (!parse_status_filter(status, &filter.query.status)) {
+                    print_status_choices();
+                    break;
+                }
+                char date[11];
+                printf("From date (YYYY-MM-DD or 'any'): ");
+                scanf("%10s", date);
+                if (!parse_date(date, &filter.from)) filter.from = NO_DATE;
+                printf("To date (YYYY-MM-DD or 'any'): ");
+                scanf("%10s", date);
+                if (!parse_date(date, &filter.to)) filter.to = NO_DATE;
+                
+                printf("Single archive file? (1=Yes, 0=No): ");
+                int single;
+                scanf("%d", &single);
+                char archive[100];
+                snprintf(archive, sizeof(archive), "Supervisor_%d_Reports.txt", supervisor_id);
+                
+                int written = export_reports(&filter, single ? archive : NULL);
+                if (written < 0) {
+                    printf("Error writing reports.\n");
+                } else if (single) {
+                    printf("%d report(s) written to %s\n", written, archive);
+                } else {
+                    printf("%d report(s) written.\n", written);
+                }
+                break;
+            }
+            case 6:
+                print_analytics(supervisor_id);
+                break;
+            case 7: {
+                // Defaults to the last seven days of unreviewed sessions.
+                SessionFilter filter = { 0, supervisor_id, false, 0 };
+                char date[11];
+                Date from, to;
+                printf("From date (YYYY-MM-DD or 'week'): ");
+                scanf("%10s", date);
+                if (!parse_date(date, &from)) {
+                    to = date_today();
+                    from = to - 6;
+                    filter.unreviewed_only = true;
+                } else {
+                    printf("To date (YYYY-MM-DD): ");
+                    to = read_date();
+                }
+                print_sessions_in_range(&filter, from, to);
+                break;
+            }
+            case 8:
                 return;
+            default:
+                printf("Invalid choice.\n");
+        }
+    }
+}
+
+// Batch mode: one command per line, comma separated, with optional
+// double quotes around fields ("" inside quotes is a literal quote).
+//
+//   case,<name>,<diagnosis>,<age>,<gender>,<contact>,<admission date>,<therapist id|auto>,<supervisor id>
+//   goal,<case id>,<description>,<target sessions>
+//   modify_goal,<case id>,<goal number>,<description>,<target sessions>
+//   session,<case id>,<date|today>,<activities>,<observations>[,<goal number>]
+//   evaluate,<case id>,<feedback>,<rating>
+//   close,<case id>,<end date>,<status>,<rating>
+//
+// Blank lines and lines starting with '#' are ignored. Every record goes
+// through apply_mutation, so it is validated exactly like interactive input.
+int split_csv(char *line, char **fields, int max_fields) {
+    int n = 0;
+    char *p = line;
+    while (n < max_fields) {
+        char *out = p;
+        fields[n++] = out;
+        if (*p == '"') {
+            p++;
+            while (*p) {
+                if (*p == '"' && p[1] == '"') {
+                    *out++ = '"';
+                    p += 2;
+                } else if (*p == '"') {
+                    p++;
+                    break;
+                } else {
+                    *out++ = *p++;
+                }
+            }
+            while (*p && *p != ',') p++;
+        } else {
+            while (*p && *p != ',') *out++ = *p++;
+        }
+        
+        bool more = (*p == ',');
+        if (*p) p++;
+        *out = '\0';
+        if (!more) break;
+    }
+    return n;
+}
+
+bool parse_int(const char *text, int *value) {
+    char *end;
+    long v = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || v < INT_MIN || v > INT_MAX) return false;
+    *value = (int)v;
+    return true;
+}
+
+bool parse_float(const char *text, float *value) {
+    char *end;
+    *value = strtof(text, &end);
+    return end != text && *end == '\0';
+}
+
+// Turns one split batch line into a mutation. Returns an error message, or
+// NULL if the line was well formed.
+const char *parse_batch_record(char **f, int n, Mutation *m, Date today) {
+    memset(m, 0, sizeof(*m));
+    
+    if (strcmp(f[0], "case") == 0) {
+        if (n != 9) return "case expects 8 fields";
+        m->type = MUT_NEW_CASE;
+        m->name = f[1];
+        m->diagnosis = f[2];
+        if (!parse_int(f[3], &m->age)) return "bad age";
+        m->gender = f[4][0];
+        m->contact = f[5];
+        if (!parse_date(f[6], &m->date)) return "bad admission date";
+        // Left at 0 for "auto"; the admission queue assigns it.
+        if (strcmp(f[7], "auto") != 0 && (!parse_int(f[7], &m->therapist_id) || m->therapist_id <= 0)) {
+            return "bad therapist id";
+        }
+        if (!parse_int(f[8], &m->supervisor_id)) return "bad supervisor id";
+    } else if (strcmp(f[0], "goal") == 0) {
+        if (n != 4) return "goal expects 3 fields";
+        m->type = MUT_ADD_GOAL;
+        if (!parse_int(f[1], &m->case_id)) return "bad case id";
+        m->description = f[2];
+        if (!parse_int(f[3], &m->target_sessions)) return "bad target sessions";
+    } else if (strcmp(f[0], "modify_goal") == 0) {
+        if (n != 5) return "modify_goal expects 4 fields";
+        m->type = MUT_MODIFY_GOAL;
+        if (!parse_int(f[1], &m->case_id)) return "bad case id";
+        if (!parse_int(f[2], &m->goal_num)) return "bad goal number";
+        m->description = f[3];
+        if (!parse_int(f[4], &m->target_sessions)) return "bad target sessions";
+    } else if (strcmp(f[0], "session") == 0) {
+        if (n != 5 && n != 6) return "session expects 4 or 5 fields";
+        m->type = MUT_SESSION;
+        if (!parse_int(f[1], &m->case_id)) return "bad case id";
+        if (strcmp(f[2], "today") == 0) m->date = today;
+        else if (!parse_date(f[2], &m->date)) return "bad session date";
+        m->activities = f[3];
+        m->observations = f[4];
+        if (n == 6 && !parse_int(f[5], &m->goal_num)) return "bad goal number";
+    } else if (strcmp(f[0], "evaluate") == 0) {
+        if (n != 4) return "evaluate expects 3 fields";
+        m->type = MUT_EVALUATE;
+        if (!parse_int(f[1], &m->case_id)) return "bad case id";
+        m->feedback = f[2];
+        if (!parse_float(f[3], &m->rating)) return "bad rating";
+    } else if (strcmp(f[0], "close") == 0) {
+        if (n != 5) return "close expects 4 fields";
+        m->type = MUT_CLOSE;
+        if (!parse_int(f[1], &m->case_id)) return "bad case id";
+        if (!parse_date(f[2], &m->date)) return "bad end date";
+        if (!parse_case_status(f[3], &m->status) || m->status == CASE_ACTIVE) return "bad status";
+        if (!parse_float(f[4], &m->rating)) return "bad rating";
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+// Consecutive admissions are collected and allocated together so auto
+// assignment can weigh the whole queue. Strings in the queue point into the
+// read buffer, so the queue is flushed before the buffer is reused.
+typedef struct {
+    Mutation items[ADMISSION_QUEUE_MAX];
+    long lines[ADMISSION_QUEUE_MAX];
+    int count;
+} AdmissionQueue;
+
+void flush_admissions(AdmissionQueue *q, long *applied, long *rejected) {
+    allocate_admissions(q->items, q->count);
+    for (int i = 0; i < q->count; i++) {
+        const char *error = NULL;
+        if (q->items[i].therapist_id == 0) {
+            error = "no therapist with free capacity";
+        } else if (commit_mutation(&q->items[i]) < 0) {
+            error = "rejected by validation";
+        }
+        if (error != NULL) {
+            fprintf(stderr, "line %ld: %s\n", q->lines[i], error);
+            (*rejected)++;
+        } else {
+            (*applied)++;
+        }
+    }
+    q->count = 0;
+}
+
+int run_batch(const char *path) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    
+    // Durability is batched much more coarsely than in interactive use; the
+    // log is synced again before reporting.
+    wal.group_records = BATCH_GROUP_COMMIT_RECORDS;
+    wal.group_ms = BATCH_GROUP_COMMIT_MS;
+    
+    Date today = date_today();
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    char *buffer = malloc(BATCH_BUFFER_BYTES + 1);
+    AdmissionQueue *admissions = malloc(sizeof(AdmissionQueue));
+    if (buffer == NULL || admissions == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    size_t filled = 0;
+    long line_no = 0, applied = 0, rejected = 0;
+    bool eof = false;
+    admissions->count = 0;
+    
+    while (!eof || filled > 0) {
+        if (!eof) {
+            size_t got = fread(buffer + filled, 1, BATCH_BUFFER_BYTES - filled, in);
+            filled += got;
+            if (got == 0) eof = true;
+        }
+        
+        size_t pos = 0;
+        while (pos < filled) {
+            char *line = buffer + pos;
+            char *nl = memchr(line, '\n', filled - pos);
+            if (nl == NULL) {
+                if (!eof && pos > 0) break;
+                if (!eof && filled == BATCH_BUFFER_BYTES) {
+                    fprintf(stderr, "line %ld: line too long\n", line_no + 1);
+                    rejected++;
+                    pos = filled;
+                    break;
+                }
+                if (!eof) break;
+                nl = buffer + filled;
+            }
+            *nl = '\0';
+            pos = nl - buffer + 1;
+            line_no++;
+            
+            size_t len = strlen(line);
+            if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+            if (len == 0 || line[0] == '#') continue;
+            
+            char *fields[BATCH_MAX_FIELDS];
+            int n = split_csv(line, fields, BATCH_MAX_FIELDS);
+            Mutation m;
+            const char *error = parse_batch_record(fields, n, &m, today);
+            if (error == NULL && m.type == MUT_NEW_CASE) {
+                admissions->items[admissions->count] = m;
+                admissions->lines[admissions->count++] = line_no;
+                if (admissions->count == ADMISSION_QUEUE_MAX) flush_admissions(admissions, &applied, &rejected);
+                continue;
+            }
+            if (error == NULL) {
+                flush_admissions(admissions, &applied, &rejected);
+                if (commit_mutation(&m) < 0) error = "rejected by validation";
+            }
+            if (error != NULL) {
+                fprintf(stderr, "line %ld: %s\n", line_no, error);
+                rejected++;
+            } else {
+                applied++;
+            }
+        }
+        flush_admissions(admissions, &applied, &rejected);
+        
+        if (pos >= filled) {
+            filled = 0;
+        } else {
+            memmove(buffer, buffer + pos, filled - pos);
+            filled -= pos;
+        }
+    }
+    
+    free(admissions);
+    free(buffer);
+    if (in != stdin) fclose(in);
+    wal_sync();
+    
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Batch complete: %ld applied, %ld rejected in %.3f s (%.0f records/s)\n",
+           applied, rejected, seconds, seconds > 0 ? applied / seconds : 0.0);
+    return rejected > 0 ? 1 : 0;
+}
+
+// Builds every lazily built index up front, so that concurrent readers
+// never trigger a build.
+void prepare_shared_indexes() {
+    ensure_secondary_indexes();
+    ensure_allocation_engine();
+    ensure_text_index();
+    ensure_date_index();
+    ensure_review_queues();
+}
+
+void *server_writer(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&write_queue_lock);
+        while (write_queue_head == NULL) pthread_cond_wait(&write_queue_ready, &write_queue_lock);
+        WriteRequest *batch = write_queue_head;
+        write_queue_head = write_queue_tail = NULL;
+        pthread_mutex_unlock(&write_queue_lock);
+        
+        // Runs of session appends go in under the read lock, so readers
+        // keep going; everything else takes the write lock. Either way the
+        // log gets the batch in the order it was applied.
+        for (WriteRequest *r = batch; r != NULL;) {
+            bool appending = r->m.type == MUT_SESSION;
+            if (appending) pthread_rwlock_rdlock(&store_lock);
+            else pthread_rwlock_wrlock(&store_lock);
+            for (; r != NULL && (r->m.type == MUT_SESSION) == appending; r = r->next) {
+                int slot;
+                if (appending) {
+                    slot = append_session(&r->m);
+                } else {
+                    if (r->m.type == MUT_NEW_CASE && r->m.therapist_id == 0) allocate_admissions(&r->m, 1);
+                    slot = r->m.therapist_id != 0 || r->m.type != MUT_NEW_CASE ? apply_mutation(&r->m) : -1;
+                }
+                r->result = slot >= 0 ? case_at(slot)->id : -1;
+                if (slot >= 0) wal_write(&r->m);
+            }
+            pthread_rwlock_unlock(&store_lock);
+        }
+        
+        // Only this thread writes the log. Holding the read lock keeps a
+        // checkpoint out while the batch is synced, but not readers.
+        pthread_rwlock_rdlock(&store_lock);
+        wal_sync();
+        bool compact = wal.size >= WAL_CHECKPOINT_BYTES;
+        pthread_rwlock_unlock(&store_lock);
+        
+        // Hand the durable batch back to the event loop.
+        WriteRequest *last = batch;
+        while (last->next != NULL) last = last->next;
+        pthread_mutex_lock(&write_done_lock);
+        last->next = write_done_head;
+        write_done_head = batch;
+        pthread_mutex_unlock(&write_done_lock);
+        uint64_t one = 1;
+        if (write(server_wake_fd, &one, sizeof(one)) < 0) perror("eventfd");
+        
+        if (compact) {
+            pthread_rwlock_wrlock(&store_lock);
+            wal_checkpoint();
+            pthread_rwlock_unlock(&store_lock);
+        }
+    }
+    return NULL;
+}
+
+// Queues a mutation for the writer; the result comes back through
+// write_done_head once it is durable.
+void server_write(WriteRequest *r) {
+    r->next = NULL;
+    pthread_mutex_lock(&write_queue_lock);
+    if (write_queue_tail != NULL) write_queue_tail->next = r;
+    else write_queue_head = r;
+    write_queue_tail = r;
+    pthread_cond_signal(&write_queue_ready);
+    pthread_mutex_unlock(&write_queue_lock);
+}
+
+static void emit_case_line(int slot, void *ctx) {
+    const TherapyCase *c = case_at(slot);
+    report_printf(ctx, "%d,%d,%d,%d,%d,%s\n", c->id, c->patient_id, c->therapist_id,
+                  c->supervisor_id, session_total(c), case_status_names[c->status]);
+}
+
+static void emit_text_hit(uint32_t doc, float score, void *ctx) {
+    const char *field;
+    char where[32];
+    char preview[61];
+    int case_id = text_hit_location(doc, &field, where, sizeof(where));
+    report_printf(ctx, "%d,%s,%s,%.2f,%.60s\n", case_id, field, where, score,
+                  str_get(text_docs[doc].ref, preview, sizeof(preview)));
+}
+
+typedef struct {
+    ReportWriter *w;
+    int therapist_id;
+    int supervisor_id;
+} SessionEmit;
+
+static void emit_session_line(const SessionDateEntry *e, void *ctx) {
+    SessionEmit *out = ctx;
+    if (e->case_slot < 0) return;
+    const TherapyCase *c = case_at(e->case_slot);
+    if (out->therapist_id && c->therapist_id != out->therapist_id) return;
+    if (out->supervisor_id && c->supervisor_id != out->supervisor_id) return;
+    const TherapySession *s = session_at(e->session);
+    report_printf(out->w, "%s,%d,%d,%d,%d\n", date_text(e->date).text, c->id, s->session_id,
+                  c->therapist_id, s->supervisor_reviewed);
+}
+
+typedef struct {
+    ExportFilter filter;
+    char path[PATH_MAX];
+} ServerExport;
+
+static void *server_export(void *arg) {
+    ServerExport *job = arg;
+    int written = export_reports(&job->filter, job->path);
+    if (written < 0) printf("Export to %s failed.\n", job->path);
+    else printf("Exported %d report(s) to %s.\n", written, job->path);
+    free(job);
+    return NULL;
+}
+
+// "export <archive> [status]" runs in the background on a read view, so
+// the reports show a single point in time while writes keep flowing.
+const char *server_start_export(const char *arg, ReportWriter *w) {
+    ServerExport *job = calloc(1, sizeof(ServerExport));
+    char status[20] = "any";
+    if (job == NULL) return "out of memory";
+    if (sscanf(arg, "%4095s %19s", job->path, status) < 1 || !parse_status_filter(status, &job->filter.query.status)) {
+        free(job);
+        return "export expects <archive path> [status]";
+    }
+    report_printf(w, "export to %s started\n", job->path);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server_export, job) != 0) {
+        free(job);
+        return "cannot start export";
+    }
+    pthread_detach(thread);
+    return NULL;
+}
+
+// Answers one read request into w. Returns an error message, or NULL.
+const char *server_read(const char *command, const char *arg, ReportWriter *w) {
+    if (strcmp(command, "ping") == 0) {
+        report_printf(w, "pong\n");
+    } else if (strcmp(command, "get") == 0 || strcmp(command, "report") == 0) {
+        int slot = find_case(atoi(arg));
+        if (slot < 0) return "no such case";
+        if (command[0] == 'r') {
+            write_progress_report(w, slot);
+        } else {
+            emit_case_line(slot, w);
+        }
+    } else if (strcmp(command, "list") == 0) {
+        CaseQuery q = { 0 };
+        char field[16] = "";
+        char value[64] = "";
+        sscanf(arg, "%15s %63s", field, value);
+        if (strcmp(field, "patient") == 0) q.patient_id = atoi(value) ? atoi(value) : -1;
+        else if (strcmp(field, "therapist") == 0) q.therapist_id = atoi(value) ? atoi(value) : -1;
+        else if (strcmp(field, "supervisor") == 0) q.supervisor_id = atoi(value) ? atoi(value) : -1;
+        else if (strcmp(field, "status") == 0) {
+            if (!parse_case_status(value, &q.status)) return "unknown status";
+        } else if (strcmp(field, "all") != 0) return "list expects patient, therapist, supervisor, status or all";
+        query_cases(&q, emit_case_line, w);
+    } else if (strcmp(command, "search") == 0) {
+        text_search(arg, emit_text_hit, w);
+    } else if (strcmp(command, "pending") == 0) {
+        int waiting[20];
+        int pending = review_list(atoi(arg), waiting, 20);
+        report_printf(w, "%d\n", pending);
+        for (int k = 0; k < pending && k < 20; k++) emit_case_line(waiting[k], w);
+    } else if (strcmp(command, "sessions") == 0) {
+        char from[11] = "", to[11] = "";
+        SessionEmit out = { w, 0, 0 };
+        Date from_date = NO_DATE, to_date = NO_DATE;
+        sscanf(arg, "%10s %10s %d %d", from, to, &out.therapist_id, &out.supervisor_id);
+        if ((from[0] && !parse_date(from, &from_date)) || (to[0] && !parse_date(to, &to_date))) return "bad date";
+        sessions_in_range(from_date, to_date, emit_session_line, &out);
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+// Reader threads take requests in arrival order and hand each answer
+// back to the event loop, so a slow report holds up only its own client.
+void *server_reader(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&read_queue_lock);
+        while (read_queue_head == NULL) pthread_cond_wait(&read_queue_ready, &read_queue_lock);
+        ReadRequest *r = read_queue_head;
+        read_queue_head = r->next;
+        if (read_queue_head == NULL) read_queue_tail = NULL;
+        pthread_mutex_unlock(&read_queue_lock);
+        
+        uint64_t start = METRIC_NOW();
+        r->reply.len = 0;
+        pthread_rwlock_rdlock(&store_lock);
+        r->error = server_read(r->command, r->arg, &r->reply);
+        pthread_rwlock_unlock(&store_lock);
+        METRIC_RECORD(OP_SERVER_READ, start);
+        
+        pthread_mutex_lock(&write_done_lock);
+        r->next = read_done_head;
+        read_done_head = r;
+        pthread_mutex_unlock(&write_done_lock);
+        uint64_t one = 1;
+        if (write(server_wake_fd, &one, sizeof(one)) < 0) perror("eventfd");
+    }
+    return NULL;
+}
+
+void server_queue_read(ReadRequest *r) {
+    r->next = NULL;
+    pthread_mutex_lock(&read_queue_lock);
+    if (read_queue_tail != NULL) read_queue_tail->next = r;
+    else read_queue_head = r;
+    read_queue_tail = r;
+    pthread_cond_signal(&read_queue_ready);
+    pthread_mutex_unlock(&read_queue_lock);
+}
+
+typedef struct Connection {
+    int fd;
+    uint32_t events;
+    ByteBuf in;
+    ByteBuf out;
+    size_t out_sent;
+    // A copy of the request line handed to a reader or writer thread;
+    // parsing of further requests waits until it has been answered,
+    // keeping replies in order.
+    char *pending_line;
+    WriteRequest write;
+    ReadRequest read;
+    bool closing;
+    bool registered;
+    bool dirty;
+    struct Connection *next_dirty;
+} Connection;
+
+Connection *dirty_connections = NULL;
+
+static void connection_mark_dirty(Connection *c) {
+    if (c->dirty) return;
+    c->dirty = true;
+    c->next_dirty = dirty_connections;
+    dirty_connections = c;
+}
+
+// Responses are "OK <length>\n" followed by exactly that many bytes of
+// body, or a single "ERR <message>\n" line. They are appended to the
+// connection's output buffer so that everything answered in one loop
+// turn goes out in a single send.
+void server_respond(Connection *c, const char *error, const ReportWriter *w) {
+    char header[64];
+    int n = error ? snprintf(header, sizeof(header), "ERR %s\n", error)
+                  : snprintf(header, sizeof(header), "OK %zu\n", w->len);
+    buf_put(&c->out, header, n);
+    if (error == NULL) buf_put(&c->out, w->data, w->len);
+    connection_mark_dirty(c);
+}
+
+// Handles one request line, which is modified in place. Reads and
+// mutations are queued and answered later from server_complete_requests().
+void server_handle(Connection *c, char *line, ReportWriter *w) {
+    w->len = 0;
+    const char *error = NULL;
+    size_t word = strcspn(line, " ,");
+    
+    if (line[word] == ',') {
+        char *copy = strdup(line);
+        char *fields[BATCH_MAX_FIELDS];
+        int n = split_csv(copy, fields, BATCH_MAX_FIELDS);
+        error = parse_batch_record(fields, n, &c->write.m, date_today());
+        if (error == NULL) {
+            c->pending_line = copy;
+            c->write.owner = c;
+            c->write.queued_ns = METRIC_NOW();
+            server_write(&c->write);
+            return;
+        }
+        free(copy);
+    } else {
+        char *arg = line + word;
+        if (*arg) *arg++ = '\0';
+        if (strcmp(line, "quit") == 0) {
+            c->closing = true;
+            connection_mark_dirty(c);
+            return;
+        }
+        if (strcmp(line, "metrics") == 0) {
+            metrics_write(w, strcmp(arg, "json") == 0);
+            server_respond(c, NULL, w);
+            return;
+        }
+        if (strcmp(line, "export") == 0) {
+            server_respond(c, server_start_export(arg, w), w);
+            return;
+        }
+        if (strcmp(line, "ping") == 0) {
+            report_printf(w, "pong\n");
+            server_respond(c, NULL, w);
+            return;
+        }
+        size_t command_len = strlen(line);
+        char *copy = malloc(command_len + 1 + strlen(arg) + 1);
+        if (copy == NULL) {
+            error = "out of memory";
+        } else {
+            strcpy(copy, line);
+            strcpy(copy + command_len + 1, arg);
+            c->pending_line = copy;
+            c->read.command = copy;
+            c->read.arg = copy + command_len + 1;
+            c->read.owner = c;
+            server_queue_read(&c->read);
+            return;
+        }
+    }
+    server_respond(c, error, w);
+}
+
+// Answers every complete line buffered on c, stopping early while a
+// mutation from this connection is still in flight.
+void connection_process(Connection *c, ReportWriter *w) {
+    size_t pos = 0;
+    while (c->pending_line == NULL && !c->closing) {
+        char *line = (char *)c->in.data + pos;
+        char *nl = memchr(line, '\n', c->in.len - pos);
+        if (nl == NULL) {
+            if (c->in.len - pos >= SERVER_MAX_LINE) {
+                server_respond(c, "line too long", w);
+                c->closing = true;
+            }
+            break;
+        }
+        *nl = '\0';
+        if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+        pos = nl - (char *)c->in.data + 1;
+        server_handle(c, line, w);
+    }
+    memmove(c->in.data, c->in.data + pos, c->in.len - pos);
+    c->in.len -= pos;
+}
+
+void server_complete_requests(ReportWriter *w) {
+    uint64_t count;
+    if (read(server_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("eventfd");
+    pthread_mutex_lock(&write_done_lock);
+    WriteRequest *done = write_done_head;
+    ReadRequest *read_done = read_done_head;
+    write_done_head = NULL;
+    read_done_head = NULL;
+    pthread_mutex_unlock(&write_done_lock);
+    
+    while (read_done != NULL) {
+        ReadRequest *next = read_done->next;
+        Connection *c = read_done->owner;
+        free(c->pending_line);
+        c->pending_line = NULL;
+        server_respond(c, read_done->error, &read_done->reply);
+        connection_process(c, w);
+        read_done = next;
+    }
+    while (done != NULL) {
+        WriteRequest *next = done->next;
+        Connection *c = done->owner;
+        METRIC_RECORD(OP_SERVER_WRITE, done->queued_ns);
+        free(c->pending_line);
+        c->pending_line = NULL;
+        w->len = 0;
+        if (done->result < 0) {
+            server_respond(c, "rejected", w);
+        } else {
+            report_printf(w, "%d\n", done->result);
+            server_respond(c, NULL, w);
+        }
+        connection_process(c, w);
+        done = next;
+    }
+}
+
+void connection_read(Connection *c, ReportWriter *w) {
+    while (!c->closing) {
+        buf_reserve(&c->in, 4096);
+        ssize_t got = recv(c->fd, c->in.data + c->in.len, c->in.capacity - c->in.len, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) break;
+        if (got <= 0) {
+            c->closing = true;
+            break;
+        }
+        c->in.len += got;
+        if (c->pending_line == NULL) connection_process(c, w);
+        // A paused connection is read no further than one full line.
+        if (c->pending_line != NULL && c->in.len >= SERVER_MAX_LINE) break;
+    }
+    connection_mark_dirty(c);
+}
+
+void connection_close(int epoll_fd, Connection *c) {
+    if (c->registered) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in.data);
+    free(c->out.data);
+    free(c->read.reply.data);
+    free(c);
+}
+
+// Sends whatever c has queued and brings its epoll interest up to date.
+// Returns false once the connection has been closed and freed.
+bool connection_flush(int epoll_fd, Connection *c) {
+    c->dirty = false;
+    while (c->out_sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_sent, c->out.len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n < 0) {
+            c->closing = true;
+            c->out_sent = c->out.len;
+            break;
+        }
+        c->out_sent += n;
+    }
+    if (c->out_sent == c->out.len) c->out.len = c->out_sent = 0;
+    
+    if (c->closing && c->out.len == 0 && c->pending_line == NULL) {
+        connection_close(epoll_fd, c);
+        return false;
+    }
+    // A hung-up socket reports EPOLLHUP on every wait, whatever it is
+    // registered for, so a connection that cannot close until its
+    // request is answered leaves epoll until then.
+    if (c->closing && c->pending_line != NULL) {
+        if (c->registered) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        c->registered = false;
+        return true;
+    }
+    
+    uint32_t events = c->out.len > 0 ? EPOLLOUT : 0;
+    if (!c->closing && (c->pending_line == NULL || c->in.len < SERVER_MAX_LINE)) events |= EPOLLIN;
+    if (!c->registered || events != c->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = c };
+        epoll_ctl(epoll_fd, c->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c->fd, &ev);
+        c->events = events;
+        c->registered = true;
+    }
+    return true;
+}
+
+void server_accept(int epoll_fd, int listener) {
+    while (1) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) fprintf(stderr, "Out of file descriptors.\n");
+            return;
+        }
+        Connection *c = calloc(1, sizeof(Connection));
+        if (c == NULL) {
+            close(fd);
+            return;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        c->registered = true;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void server_stop(int sig) {
+    (void)sig;
+    server_stopping = 1;
+}
+
+// Lifts the open file limit as far as the hard limit allows, for the
+// thousands of sockets a server or load generator may hold.
+void raise_file_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int run_server(const char *socket_path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long.\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    raise_file_limit();
+    
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s\n", socket_path);
+        return 1;
+    }
+    
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || server_wake_fd < 0) {
+        perror("epoll");
+        return 1;
+    }
+    // The listener and the wake-up eventfd are told apart from
+    // connections by their (non-heap) tag addresses.
+    static int listener_tag, wake_tag;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listener_tag };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &ev);
+    ev.data.ptr = &wake_tag;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_wake_fd, &ev);
+    
+    prepare_shared_indexes();
+    pthread_t writer;
+    pthread_create(&writer, NULL, server_writer, NULL);
+    // At least a few readers even on one core, so that a long report
+    // only ever ties up one of them.
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int readers = cpus < SERVER_MIN_READERS ? SERVER_MIN_READERS : cpus > SERVER_MAX_READERS ? SERVER_MAX_READERS : (int)cpus;
+    for (int k = 0; k < readers; k++) {
+        pthread_t reader;
+        pthread_create(&reader, NULL, server_reader, NULL);
+    }
+    
+    struct sigaction sa = { 0 };
+    sa.sa_handler = server_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving on %s with %d reader(s)\n", socket_path, readers);
+    fflush(stdout);
+    
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    ReportWriter w = { 0 };
+    while (!server_stopping) {
+        int n = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listener_tag) {
+                server_accept(epoll_fd, listener);
+            } else if (tag == &wake_tag) {
+                server_complete_requests(&w);
+            } else {
+                Connection *c = tag;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) connection_read(c, &w);
+                if (events[i].events & EPOLLOUT) connection_mark_dirty(c);
+            }
+        }
+        // Freed connections never appear twice in one batch: a closing
+        // connection is only released here, after all its events.
+        while (dirty_connections != NULL) {
+            Connection *c = dirty_connections;
+            dirty_connections = c->next_dirty;
+            connection_flush(epoll_fd, c);
+        }
+    }
+    
+    // Writes in flight finish before the checkpoint; clients still
+    // connected are simply dropped when the process exits.
+    close(listener);
+    unlink(socket_path);
+    pthread_rwlock_wrlock(&store_lock);
+    wal_checkpoint();
+    printf("Server stopped.\n");
+    return 0;
+}
+
+typedef struct {
+    const char *socket_path;
+    long requests;
+    int client;
+    int write_percent;
+    int cases;
+    uint32_t *latency_us;
+    long failures;
+} LoadClient;
+
+int loadgen_connect(const char *socket_path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Sends one request and reads its whole response. Returns true for OK.
+bool loadgen_request(int fd, const char *line, ByteBuf *reply) {
+    if (send(fd, line, strlen(line), MSG_NOSIGNAL) < 0) return false;
+    reply->len = 0;
+    size_t need = 0;
+    while (1) {
+        if (need == 0) {
+            char *nl = reply->len ? memchr(reply->data, '\n', reply->len) : NULL;
+            if (nl != NULL) {
+                if (strncmp((char *)reply->data, "OK ", 3) != 0) return false;
+                need = nl - (char *)reply->data + 1 + strtoul((char *)reply->data + 3, NULL, 10);
+            }
+        }
+        if (need > 0 && reply->len >= need) return true;
+        buf_reserve(reply, 4096);
+        ssize_t got = recv(fd, reply->data + reply->len, reply->capacity - reply->len, 0);
+        if (got <= 0) return false;
+        reply->len += got;
+    }
+}
+
+void *loadgen_client(void *arg) {
+    LoadClient *lc = arg;
+    static const char *requests[] = { "ping\n", "get 1\n", "report 1\n", "pending 1\n", "list therapist 1\n" };
+    ByteBuf reply = { 0 };
+    char line[96];
+    int fd = loadgen_connect(lc->socket_path);
+    for (long i = 0; i < lc->requests; i++) {
+        const char *request = requests[(i + lc->client) % 5];
+        if (i % 100 < lc->write_percent) {
+            snprintf(line, sizeof(line), "session,%ld,today,load test,ok\n", 1 + (i * 7919 + lc->client) % lc->cases);
+            request = line;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (fd < 0 || !loadgen_request(fd, request, &reply)) lc->failures++;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        lc->latency_us[i] = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    }
+    if (fd >= 0) close(fd);
+    free(reply.data);
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Holds idle connections open against a running server while a few
+// active clients measure request latency, then checks that the idle
+// connections are still served. write_percent of the requests record a
+// session against one of cases 1..cases.
+int run_loadgen(const char *socket_path, int idle, long requests, int clients, int write_percent, int cases) {
+    raise_file_limit();
+    signal(SIGPIPE, SIG_IGN);
+    int *idle_fds = malloc((idle > 0 ? idle : 1) * sizeof(int));
+    uint32_t *latency_us = malloc((requests > 0 ? requests : 1) * sizeof(uint32_t));
+    LoadClient *lc = calloc(clients, sizeof(LoadClient));
+    pthread_t *threads = calloc(clients, sizeof(pthread_t));
+    if (idle_fds == NULL || latency_us == NULL || lc == NULL || threads == NULL) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int opened = 0;
+    while (opened < idle && (idle_fds[opened] = loadgen_connect(socket_path)) >= 0) opened++;
+    printf("Opened %d idle connection(s) in %.0f ms\n", opened, elapsed_ms_precise(&start));
+    if (opened < idle) fprintf(stderr, "Could only open %d of %d connections.\n", opened, idle);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long offset = 0;
+    for (int i = 0; i < clients; i++) {
+        lc[i].socket_path = socket_path;
+        lc[i].client = i;
+        lc[i].write_percent = write_percent;
+        lc[i].cases = cases;
+        lc[i].requests = requests / clients + (i < requests % clients);
+        lc[i].latency_us = latency_us + offset;
+        offset += lc[i].requests;
+        pthread_create(&threads[i], NULL, loadgen_client, &lc[i]);
+    }
+    long failures = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        failures += lc[i].failures;
+    }
+    double ms = elapsed_ms_precise(&start);
+    
+    qsort(latency_us, requests, sizeof(uint32_t), compare_u32);
+    printf("%ld request(s) from %d client(s) in %.0f ms (%.0f requests/s), %ld failed\n",
+           requests, clients, ms, ms > 0 ? requests * 1000.0 / ms : 0.0, failures);
+    if (requests > 0) {
+        printf("Latency us: p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+               latency_us[requests / 2], latency_us[requests * 9 / 10], latency_us[requests * 99 / 100],
+               latency_us[requests * 999 / 1000], latency_us[requests - 1]);
+    }
+    
+    int alive = 0, probed = 0;
+    ByteBuf reply = { 0 };
+    for (int i = 0; i < opened; i += opened / 100 + 1, probed++) {
+        alive += loadgen_request(idle_fds[i], "ping\n", &reply);
+    }
+    printf("%d of %d probed idle connection(s) still answering\n", alive, probed);
+    for (int i = 0; i < opened; i++) close(idle_fds[i]);
+    
+    free(reply.data);
+    free(idle_fds);
+    free(latency_us);
+    free(lc);
+    free(threads);
+    return failures > 0 || alive < probed ? 1 : 0;
+}
+
+static void count_slot(int slot, void *ctx) {
+    (void)slot;
+    (*(long *)ctx)++;
+}
+
+static void count_entry(const SessionDateEntry *e, void *ctx) {
+    (void)e;
+    (*(long *)ctx)++;
+}
+
+static void count_hit(uint32_t doc, float score, void *ctx) {
+    (void)doc;
+    (void)score;
+    (*(long *)ctx)++;
+}
+
+// Stress test for concurrent session appends. Writers append to a few
+// cases of a generated clinic through append_session, holding the store
+// lock only for reading, while readers walk the chains, search the text
+// and date indexes and read through views under the same lock. Each
+// append records when it started and finished, which together with the
+// session number it got makes the run checkable afterwards.
+typedef struct {
+    int case_slot;
+    int session_id;
+    long start_ns;
+    long end_ns;
+} StressOp;
+
+typedef struct {
+    const int *slots;
+    int case_total;
+    int worker;
+    long first_op;
+    long appends;
+    StressOp *ops;
+    long op_total;
+    _Atomic int *writers_left;
+    long walks;
+    long views;
+    long errors;
+} StressWorker;
+
+static long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+#define STRESS_BASE_DATE 738000
+
+// The observations stored with an append, checked by readers for torn
+// publication.
+static void stress_check(long op, char *out, size_t size) {
+    snprintf(out, size, "check %08lx", (unsigned long)((op * 2654435761u) ^ 0x5bd1e995u));
+}
+
+void *stress_writer(void *arg) {
+    StressWorker *sw = arg;
+    char activities[32], observations[32];
+    for (long i = 0; i < sw->appends; i++) {
+        long id = sw->first_op + i;
+        int k = (int)((i * 7919 + sw->worker) % sw->case_total);
+        StressOp *op = &sw->ops[id];
+        op->case_slot = sw->slots[k];
+        snprintf(activities, sizeof(activities), "stress op%ld", id);
+        stress_check(id, observations, sizeof(observations));
+        
+        Mutation m = { MUT_SESSION };
+        m.case_id = case_at(sw->slots[k])->id;
+        m.date = STRESS_BASE_DATE + (int)(id % 997);
+        m.activities = activities;
+        m.observations = observations;
+        m.goal_num = (int)(i % 3) + 1;
+        
+        pthread_rwlock_rdlock(&store_lock);
+        op->start_ns = monotonic_ns();
+        if (append_session(&m) < 0) sw->errors++;
+        op->end_ns = monotonic_ns();
+        pthread_rwlock_unlock(&store_lock);
+    }
+    atomic_fetch_sub(sw->writers_left, 1);
+    return NULL;
+}
+
+// Checks one session: its number is its place in the chain and its
+// payload is the one its writer stored for that case.
+static bool stress_session_ok(const StressWorker *sw, const TherapyCase *c, int slot, int idx, int place) {
+    const TherapySession *s = session_at(idx);
+    char activities[32], observations[32], expected[32];
+    long id;
+    if (s->session_id != place || s->case_id != c->id ||
+        sscanf(str_get(s->activities, activities, sizeof(activities)), "stress op%ld", &id) != 1 ||
+        id < 0 || id >= sw->op_total || sw->ops[id].case_slot != slot) {
+        return false;
+    }
+    stress_check(id, expected, sizeof(expected));
+    return strcmp(str_get(s->observations, observations, sizeof(observations)), expected) == 0;
+}
+
+// Walks chains while writers run. A walk must see session numbers 1, 2,
+// 3, ... with intact payloads, be at least as long as the count read
+// before it, and never be shorter than an earlier walk of the same case.
+// Now and then the walk goes through a read view instead, which must
+// show exactly the sessions the view counted, and the indexes are
+// searched to keep their locks busy.
+void *stress_reader(void *arg) {
+    StressWorker *sw = arg;
+    int *seen = calloc(sw->case_total, sizeof(int));
+    if (seen == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (unsigned k = sw->worker; atomic_load(sw->writers_left) > 0; k = k * 1103515245u + 12345u) {
+        int pick = k % sw->case_total, slot = sw->slots[pick];
+        pthread_rwlock_rdlock(&store_lock);
+        if (sw->walks % 16 == 0) {
+            ReadView *v = read_view_open();
+            pthread_rwlock_unlock(&store_lock);
+            read_view_enter(v);
+            const TherapyCase *c = case_at(slot);
+            int length = 0;
+            for (int idx = session_first(c); idx != NO_SESSION && length < c->session_count; idx = session_next(idx)) {
+                if (idx >= v->session_count || !stress_session_ok(sw, c, slot, idx, ++length)) break;
+            }
+            if (length != c->session_count) sw->errors++;
+            read_view_enter(NULL);
+            read_view_close(v);
+            sw->views++;
+            pthread_rwlock_rdlock(&store_lock);
+        }
+        if (sw->walks % 64 == 0) {
+            long hits = 0, rows = 0;
+            text_search("stress", count_hit, &hits);
+            sessions_in_range(STRESS_BASE_DATE, STRESS_BASE_DATE + 30, count_entry, &rows);
+            review_pending(case_at(slot)->supervisor_id);
         }
         
-        if (match) {
-            char patient_name[50] = "Unknown";
-            for (int j = 0; j < patient_count; j++) {
-                if (patients[j].id == c->patient_id) {
-                    strncpy(patient_name, patients[j].name, sizeof(patient_name));
-                    break;
-                }
+        const TherapyCase *c = case_at(slot);
+        int counted = session_total(c);
+        int length = 0;
+        for (int idx = session_first(c); idx != NO_SESSION; idx = session_next(idx)) {
+            if (!stress_session_ok(sw, c, slot, idx, ++length)) {
+                sw->errors++;
+                break;
             }
-            
-            printf("%d\t%.15s\t%d\t\t%d\t\t%s\n", 
-                  c->id, patient_name, c->therapist_id, 
-                  c->session_count, c->status);
         }
+        pthread_rwlock_unlock(&store_lock);
+        if (length < counted || length < seen[pick]) sw->errors++;
+        seen[pick] = length;
+        sw->walks++;
     }
+    free(seen);
+    return NULL;
 }
 
-void close_case(int case_index) {
-    if (case_index < 0 || case_index >= case_count) {
-        printf("Invalid case index.\n");
-        return;
+static int compare_stress_ops(const void *a, const void *b) {
+    const StressOp *x = a, *y = b;
+    if (x->case_slot != y->case_slot) return x->case_slot - y->case_slot;
+    return x->session_id - y->session_id;
+}
+
+// Appends to one case are linearizable if session numbers are exactly
+// 1..n and respect real time: an append that finished before another
+// started must have the lower number.
+static long stress_violations(StressOp *ops, long n) {
+    qsort(ops, n, sizeof(StressOp), compare_stress_ops);
+    long violations = 0;
+    for (long end = n; end > 0;) {
+        long begin = end - 1;
+        while (begin > 0 && ops[begin - 1].case_slot == ops[end - 1].case_slot) begin--;
+        if (case_at(ops[begin].case_slot)->session_count != end - begin) violations++;
+        
+        long min_end = LONG_MAX;
+        for (long i = end - 1; i >= begin; i--) {
+            if (ops[i].session_id != i - begin + 1) violations++;
+            if (min_end < ops[i].start_ns) violations++;
+            if (ops[i].end_ns < min_end) min_end = ops[i].end_ns;
+        }
+        end = begin;
+    }
+    return violations;
+}
+
+// What the appends left in the goals, indexes and review queues, once
+// the writers are done. Every append advances one goal and adds one entry
+// to the date index and one "stress" match to the text index.
+static long stress_index_errors(const int *slots, int cases, long appends) {
+    long errors = 0, waiting = 0, rows = 0, hits = 0;
+    for (int k = 0; k < cases; k++) {
+        const TherapyCase *c = case_at(slots[k]);
+        int achieved = 0;
+        for (int g = 0; g < c->goal_count; g++) achieved += case_goals(slots[k])[g].achieved;
+        if (achieved != c->session_count) errors++;
+        waiting += c->session_count >= EVALUATION_MIN_SESSIONS;
+    }
+    int queued = 0;
+    for (int i = 0; i < supervisor_count; i++) queued += review_pending(supervisor_at(i)->id);
+    if (queued != waiting) errors++;
+    if (sessions_in_range(NO_DATE, NO_DATE, count_entry, &rows) != appends) errors++;
+    if (text_search("stress", count_hit, &hits) != appends) errors++;
+    return errors;
+}
+
+int run_session_stress(int writers, long appends, int cases) {
+    int readers = writers < 2 ? 1 : writers / 2;
+    int *slots = malloc(cases * sizeof(int));
+    StressOp *ops = malloc((appends > 0 ? appends : 1) * sizeof(StressOp));
+    StressWorker *workers = calloc(writers + readers, sizeof(StressWorker));
+    pthread_t *threads = calloc(writers + readers, sizeof(pthread_t));
+    if (slots == NULL || ops == NULL || workers == NULL || threads == NULL) {
+        printf("Out of memory.\n");
+        return 1;
     }
     
-    TherapyCase *c = &cases[case_index];
-    if (!c->is_active) {
-        printf("Case is already closed.\n");
-        return;
+    // A clinic of just staff, then the cases by hand so that none is
+    // closed, each with three goals that are never reached.
+    ClinicConfig cfg = { 0, cases / 2 + 3, 0, 0, 0, 8, 0 };
+    generate_clinic(&cfg, NULL, NULL);
+    caseload_limit = cases + 5;
+    for (int k = 0; k < cases; k++) {
+        Mutation m = { MUT_NEW_CASE };
+        m.name = "Stress Patient";
+        m.diagnosis = "Dysarthria";
+        m.age = 40;
+        m.gender = 'F';
+        m.contact = "555-0100";
+        m.date = STRESS_BASE_DATE - 7;
+        m.supervisor_id = k % cfg.supervisors + 1;
+        allocate_admissions(&m, 1);
+        slots[k] = apply_mutation(&m);
+        if (slots[k] < 0) {
+            fprintf(stderr, "Could not admit stress case %d.\n", k + 1);
+            return 1;
+        }
+        Mutation goal = { MUT_ADD_GOAL };
+        goal.case_id = case_at(slots[k])->id;
+        goal.description = "Improve intelligibility";
+        goal.target_sessions = INT_MAX;
+        for (int g = 0; g < 3; g++) apply_mutation(&goal);
     }
+    prepare_shared_indexes();
     
-    printf("Enter end date (YYYY-MM-DD): ");
-    char date[11];
-    scanf("%10s", date);
-    while (!validate_date(date)) {
-        printf("Invalid date format. Please use YYYY-MM-DD: ");
-        scanf("%10s", date);
+    _Atomic int writers_left = writers;
+    long offset = 0;
+    for (int i = 0; i < writers + readers; i++) {
+        StressWorker *sw = &workers[i];
+        sw->slots = slots;
+        sw->case_total = cases;
+        sw->ops = ops;
+        sw->op_total = appends;
+        sw->writers_left = &writers_left;
+        if (i < writers) {
+            sw->worker = i;
+            sw->first_op = offset;
+            sw->appends = appends / writers + (i < appends % writers);
+            offset += sw->appends;
+        } else {
+            sw->worker = i - writers;
+        }
     }
-    strcpy(c->end_date, date);
     
-    printf("Enter status (Completed/Discontinued): ");
-    scanf("%19s", c->status);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < writers + readers; i++) {
+        pthread_create(&threads[i], NULL, i < writers ? stress_writer : stress_reader, &workers[i]);
+    }
+    long walks = 0, views = 0, errors = 0;
+    for (int i = 0; i < writers + readers; i++) {
+        pthread_join(threads[i], NULL);
+        walks += workers[i].walks;
+        views += workers[i].views;
+        errors += workers[i].errors;
+    }
+    double ms = elapsed_ms_precise(&start);
     
-    printf("Final clinical rating (0.0-5.0): ");
-    scanf("%f", &c->clinical_rating);
+    // Session numbers are read back from the chains, which is also where
+    // a lost or duplicated append would show.
+    long linked = 0;
+    for (int k = 0; k < cases; k++) {
+        for (int idx = session_first(case_at(slots[k])); idx != NO_SESSION; idx = session_next(idx), linked++) {
+            char activities[32];
+            long id;
+            const TherapySession *s = session_at(idx);
+            if (sscanf(str_get(s->activities, activities, sizeof(activities)), "stress op%ld", &id) == 1 &&
+                id >= 0 && id < appends) {
+                ops[id].session_id = s->session_id;
+            }
+        }
+    }
+    long index_errors = stress_index_errors(slots, cases, appends);
+    long violations = stress_violations(ops, appends) + (linked != appends);
     
-    c->is_active = false;
+    printf("%ld append(s) by %d writer(s) to %d case(s) in %.0f ms (%.0f appends/s)\n",
+           appends, writers, cases, ms, ms > 0 ? appends * 1000.0 / ms : 0.0);
+    printf("%ld chain walk(s) and %ld view(s) by %d reader(s): %ld inconsistent\n", walks, views, readers, errors);
+    printf("Goals, date, text and review indexes: %ld mismatch(es)\n", index_errors);
+    printf("Linearizability check: %ld violation(s)\n", violations);
     
-    // Update therapist's case count
-    for (int i = 0; i < therapist_count; i++) {
-        if (therapists[i].id == c->therapist_id) {
-            therapists[i].current_cases--;
-            break;
-        }
+    free(slots);
+    free(ops);
+    free(workers);
+    free(threads);
+    return errors > 0 || index_errors > 0 || violations > 0 ? 1 : 0;
+}
+
+static uint64_t gen_state;
+
+static uint32_t gen_next() {
+    gen_state ^= gen_state >> 12;
+    gen_state ^= gen_state << 25;
+    gen_state ^= gen_state >> 27;
+    return (uint32_t)((gen_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int gen_range(int lo, int hi) {
+    return lo + (int)(gen_next() % (uint32_t)(hi - lo + 1));
+}
+
+#define GEN_PICK(list) (list[gen_next() % (sizeof(list) / sizeof(list[0]))])
+
+static const char *gen_first_names[] = {
+    "Aisha", "Ben", "Carmen", "David", "Elena", "Farid", "Grace", "Hiro", "Isla", "Jonas",
+    "Kavya", "Liam", "Maya", "Noah", "Olga", "Priya", "Quinn", "Rosa", "Samuel", "Tara"
+};
+static const char *gen_last_names[] = {
+    "Anders", "Brooks", "Chen", "Diaz", "Evans", "Fischer", "Gupta", "Hughes", "Ito", "Jensen",
+    "Khan", "Lopez", "Moreau", "Nair", "Okafor", "Patel", "Rossi", "Silva", "Tanaka", "Walsh"
+};
+
+// Diagnoses paired with the age range of patients who typically have them.
+static const struct { const char *text; int min_age, max_age; } gen_diagnoses[] = {
+    { "Childhood stuttering", 3, 12 }, { "Articulation delay", 3, 9 },
+    { "Phonological disorder", 3, 8 }, { "Expressive language delay", 2, 7 },
+    { "Developmental apraxia of speech", 3, 10 }, { "Aphasia after stroke", 45, 90 },
+    { "Primary progressive aphasia", 55, 85 }, { "Vocal nodules", 18, 65 },
+    { "Muscle tension dysphonia", 20, 70 }, { "Dysphagia after stroke", 50, 92 },
+    { "Oropharyngeal dysphagia", 40, 90 }, { "Dysarthria", 30, 85 }
+};
+
+static const char *gen_specialties[] = {
+    "General Speech Therapy", "Child Speech Disorders", "Aphasia Rehabilitation",
+    "Voice Disorders", "Swallowing Disorders"
+};
+
+static const char *gen_words[] = {
+    "articulation", "fluency", "breath", "support", "phoneme", "drills", "carryover", "pacing",
+    "modeling", "prompting", "syllable", "blends", "vowel", "consonant", "intelligibility",
+    "swallow", "strategy", "chin", "tuck", "resonance", "pitch", "volume", "naming", "retrieval",
+    "comprehension", "sentence", "repetition", "reading", "conversation", "turn", "taking",
+    "narrative", "picture", "description", "minimal", "pairs", "home", "practice", "parent",
+    "training", "accuracy", "improved", "cues", "verbal", "visual", "tactile", "independent",
+    "structured", "play", "oral", "motor", "exercises", "tongue", "lip", "strength", "voice",
+    "rest", "hydration", "easy", "onset", "stretched", "speech", "self", "monitoring", "word",
+    "finding", "category", "auditory", "discrimination", "with", "during", "and", "the", "of",
+    "patient", "session", "target", "level", "good", "moderate", "minimal", "max", "consistent"
+};
+
+static const char *gen_goal_targets[] = {
+    "sound accuracy in words", "fluent speech in conversation", "word retrieval for daily needs",
+    "safe swallowing of thin liquids", "vocal hygiene routine", "sentence length in narratives",
+    "intelligibility to unfamiliar listeners", "breath support for phrases", "following directions"
+};
+
+// A note of roughly `words` words, varying by half either way.
+static void gen_note(char *out, size_t size, int words) {
+    int n = gen_range(words / 2 > 0 ? words / 2 : 1, words + words / 2);
+    size_t len = 0;
+    for (int i = 0; i < n && len + 20 < size; i++) {
+        len += snprintf(out + len, size - len, "%s%s", i ? " " : "", GEN_PICK(gen_words));
     }
+    if (len > 0) out[0] = toupper((unsigned char)out[0]);
+    snprintf(out + len, size - len, ".");
+}
+
+static void gen_staff(const ClinicConfig *cfg) {
+    pool_reserve(&therapist_pool, cfg->therapists);
+    for (int i = 0; i < cfg->therapists; i++) {
+        Therapist *t = therapist_at(i);
+        const char *first = GEN_PICK(gen_first_names), *last = GEN_PICK(gen_last_names);
+        memset(t, 0, sizeof(*t));
+        t->id = i + 1;
+        snprintf(t->name, sizeof(t->name), "%s %s", first, last);
+        snprintf(t->specialization, sizeof(t->specialization), "%s", gen_specialties[i % 5]);
+        snprintf(t->email, sizeof(t->email), "therapist%d@therapy.com", i + 1);
+    }
+    therapist_count = cfg->therapists;
     
-    printf("\nCase %d closed successfully.\n", c->id);
+    pool_reserve(&supervisor_pool, cfg->supervisors);
+    for (int i = 0; i < cfg->supervisors; i++) {
+        Supervisor *sup = supervisor_at(i);
+        memset(sup, 0, sizeof(*sup));
+        sup->id = i + 1;
+        snprintf(sup->name, sizeof(sup->name), "Dr. %s %s", GEN_PICK(gen_first_names), GEN_PICK(gen_last_names));
+        snprintf(sup->email, sizeof(sup->email), "supervisor%d@therapy.com", i + 1);
+    }
+    supervisor_count = cfg->supervisors;
+    rebuild_indexes();
 }
 
-void therapist_dashboard(int therapist_id) {
-    Therapist *t = NULL;
-    for (int i = 0; i < therapist_count; i++) {
-        if (therapists[i].id == therapist_id) {
-            t = &therapists[i];
-            break;
+static void gen_report(PhaseReport report, void *ctx, const char *phase, struct timespec *start, long ops) {
+    if (report != NULL) report(phase, elapsed_ms_precise(start), ops, ctx);
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+// Builds a clinic into the empty in-memory store through the regular
+// appliers: staff, admissions placed by the allocation engine, therapy
+// plans, weekly sessions, evaluations and some discharges, after which
+// the text is compressed against its own dictionary. Each phase
+// is timed and passed to report.
+void generate_clinic(ClinicConfig *cfg, PhaseReport report, void *ctx) {
+    if (cfg->therapists <= 0) cfg->therapists = cfg->cases / 20 + 3;
+    if (cfg->supervisors <= 0) cfg->supervisors = cfg->therapists / 10 + 2;
+    if (cfg->goals_per_case > MAX_GOALS) cfg->goals_per_case = MAX_GOALS;
+    gen_state = cfg->seed ? cfg->seed : 0x9E3779B97F4A7C15ULL;
+    // Leave room for every admission to be placed.
+    int per_therapist = cfg->cases / cfg->therapists + 5;
+    if (caseload_limit < per_therapist) caseload_limit = per_therapist;
+    
+    Date today = date_today();
+    char text[2][512];
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gen_staff(cfg);
+    gen_report(report, ctx, "staff", &start, cfg->therapists + cfg->supervisors);
+    
+    Mutation *queue = malloc(ADMISSION_QUEUE_MAX * sizeof(Mutation));
+    char (*names)[100] = malloc(ADMISSION_QUEUE_MAX * sizeof(*names));
+    if (queue == NULL || names == NULL) {
+        printf("Out of memory.\n");
+        exit(1);
+    }
+    for (int done = 0; done < cfg->cases;) {
+        int n = cfg->cases - done < ADMISSION_QUEUE_MAX ? cfg->cases - done : ADMISSION_QUEUE_MAX;
+        for (int i = 0; i < n; i++) {
+            int d = gen_next() % (sizeof(gen_diagnoses) / sizeof(gen_diagnoses[0]));
+            Mutation *m = &queue[i];
+            memset(m, 0, sizeof(*m));
+            m->type = MUT_NEW_CASE;
+            snprintf(names[i], sizeof(names[i]), "%s %s", GEN_PICK(gen_first_names), GEN_PICK(gen_last_names));
+            m->name = names[i];
+            m->diagnosis = gen_diagnoses[d].text;
+            m->age = gen_range(gen_diagnoses[d].min_age, gen_diagnoses[d].max_age);
+            m->gender = gen_next() & 1 ? 'F' : 'M';
+            m->contact = "555-0100";
+            m->date = today - 7 * cfg->sessions_per_case - gen_range(7, 700);
+            m->supervisor_id = gen_range(1, cfg->supervisors);
+        }
+        allocate_admissions(queue, n);
+        for (int i = 0; i < n; i++) {
+            if (queue[i].therapist_id != 0) apply_mutation(&queue[i]);
         }
+        done += n;
     }
+    free(queue);
+    free(names);
+    gen_report(report, ctx, "allocation", &start, case_count);
     
-    if (t == NULL) {
-        printf("Therapist not found.\n");
-        return;
+    long goals = 0;
+    for (int slot = 0; slot < case_count; slot++) {
+        Mutation m = { MUT_ADD_GOAL };
+        m.case_id = case_at(slot)->id;
+        for (int g = 0; g < cfg->goals_per_case; g++) {
+            snprintf(text[0], sizeof(text[0]), "Improve %s", GEN_PICK(gen_goal_targets));
+            m.description = text[0];
+            m.target_sessions = gen_range(6, 20);
+            goals += apply_mutation(&m) >= 0;
+        }
     }
+    gen_report(report, ctx, "therapy_plans", &start, goals);
     
-    int choice;
+    // Weekly sessions, interleaved across cases as they would arrive.
+    long sessions = 0;
+    for (int week = 0; week < cfg->sessions_per_case; week++) {
+        for (int slot = 0; slot < case_count; slot++) {
+            TherapyCase *c = case_at(slot);
+            Mutation m = { MUT_SESSION };
+            m.case_id = c->id;
+            m.date = c->start_date + 7 * (week + 1);
+            gen_note(text[0], sizeof(text[0]), cfg->note_words);
+            gen_note(text[1], sizeof(text[1]), cfg->note_words);
+            m.activities = text[0];
+            m.observations = text[1];
+            m.goal_num = c->goal_count ? week % c->goal_count + 1 : 0;
+            sessions += apply_mutation(&m) >= 0;
+        }
+    }
+    gen_report(report, ctx, "record_session", &start, sessions);
     
-    while(1) {
-        print_menu_header("Therapist Dashboard");
-        printf("Welcome, %s (%s)\n", t->name, t->specialization);
-        printf("Current cases: %d\n\n", t->current_cases);
-        
-        printf("1. View My Cases\n");
-        printf("2. Record Session\n");
-        printf("3. Create/Modify Therapy Plan\n");
-        printf("4. Generate Progress Report\n");
-        printf("5. Return to Main Menu\n");
-        printf("Choice: ");
-        scanf("%d", &choice);
-        
-        switch(choice) {
-            case 1: {
-                printf("\nYour Active Cases:\n");
-                printf("ID\tPatient\tSessions\n");
-                printf("------------------------\n");
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].therapist_id == therapist_id && cases[i].is_active) {
-                        char patient_name[50] = "Unknown";
-                        for (int j = 0; j < patient_count; j++) {
-                            if (patients[j].id == cases[i].patient_id) {
-                                strncpy(patient_name, patients[j].name, sizeof(patient_name));
-                                break;
-                            }
-                        }
-                        printf("%d\t%.15s\t%d\n", cases[i].id, patient_name, cases[i].session_count);
-                    }
-                }
-                break;
-            }
-            case 2: {
-                printf("Enter Case ID to record session: ");
-                int case_id;
-                scanf("%d", &case_id);
-                bool found = false;
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].therapist_id == therapist_id) {
-                        record_session(i);
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) printf("Case not found or not assigned to you.\n");
-                break;
-            }
-            case 3: {
-                printf("Enter Case ID to modify plan: ");
-                int case_id;
-                scanf("%d", &case_id);
-                bool found = false;
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].therapist_id == therapist_id) {
-                        create_therapy_plan(i);
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) printf("Case not found or not assigned to you.\n");
-                break;
-            }
-            case 4: {
-                printf("Enter Case ID to generate report: ");
-                int case_id;
-                scanf("%d", &case_id);
-                bool found = false;
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].therapist_id == therapist_id) {
-                        generate_progress_report(i, false);
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) printf("Case not found or not assigned to you.\n");
-                break;
-            }
-            case 5:
-                return;
-            default:
-                printf("Invalid choice.\n");
+    long closed = 0, evaluated = 0;
+    for (int slot = 0; slot < case_count; slot++) {
+        TherapyCase *c = case_at(slot);
+        Mutation m = { MUT_EVALUATE };
+        m.case_id = c->id;
+        if (c->session_count >= EVALUATION_MIN_SESSIONS && gen_next() % 2 == 0) {
+            gen_note(text[0], sizeof(text[0]), cfg->note_words);
+            m.feedback = text[0];
+            m.rating = gen_range(2, 5);
+            evaluated += apply_mutation(&m) >= 0;
+        }
+        if (gen_next() % 100 < 15) {
+            m.type = MUT_CLOSE;
+            m.date = c->last_session != NO_SESSION ? session_at(c->last_session)->date + 7 : c->start_date + 7;
+            m.status = gen_next() % 3 ? CASE_COMPLETED : CASE_DISCHARGED;
+            m.rating = gen_range(3, 5);
+            closed += apply_mutation(&m) >= 0;
         }
     }
+    gen_report(report, ctx, "evaluate_close", &start, evaluated + closed);
+    
+    size_t before, after;
+    uint32_t words = text_store_train(&before, &after);
+    gen_report(report, ctx, "text_dictionary", &start, words);
 }
 
-void supervisor_dashboard(int supervisor_id) {
-    Supervisor *s = NULL;
-    for (int i = 0; i < supervisor_count; i++) {
-        if (supervisors[i].id == supervisor_id) {
-            s = &supervisors[i];
-            break;
-        }
+static void print_phase(const char *phase, double ms, long ops, void *ctx) {
+    (void)ctx;
+    printf("%-16s %10.1f ms %10ld ops\n", phase, ms, ops);
+}
+
+// Writes a generated clinic to the data file. Refuses to touch an
+// existing one.
+int run_generate(ClinicConfig *cfg) {
+    if (access(FILENAME, F_OK) == 0 || access(WAL_FILENAME, F_OK) == 0) {
+        fprintf(stderr, "%s or %s already exists; generate into an empty directory.\n", FILENAME, WAL_FILENAME);
+        return 1;
+    }
+    generate_clinic(cfg, print_phase, NULL);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    save_data();
+    print_phase("save_data", elapsed_ms_precise(&start), case_count, NULL);
+    printf("Generated %d case(s), %d session(s), %d therapist(s), %d supervisor(s).\n",
+           case_count, session_log_count, therapist_count, supervisor_count);
+    return 0;
+}
+
+typedef struct {
+    FILE *json;
+    int cases;
+} BenchOutput;
+
+static void bench_phase(const char *phase, double ms, long ops, void *ctx) {
+    BenchOutput *out = ctx;
+    double rate = ms > 0 ? ops * 1000.0 / ms : 0.0;
+    printf("%9d  %-20s %10.1f ms %10ld ops %12.0f ops/s\n", out->cases, phase, ms, ops, rate);
+    fflush(stdout);
+    if (out->json != NULL) {
+        fprintf(out->json, "{\"cases\": %d, \"phase\": \"%s\", \"ms\": %.3f, \"ops\": %ld, \"ops_per_s\": %.1f}\n",
+                out->cases, phase, ms, ops, rate);
+        fflush(out->json);
     }
+}
+
+// Times the read side against a freshly loaded snapshot.
+static void bench_queries(BenchOutput *out) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    load_data();
+    rebuild_indexes();
+    bench_phase("load_data", elapsed_ms_precise(&start), case_count, out);
     
-    if (s == NULL) {
-        printf("Supervisor not found.\n");
-        return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ensure_secondary_indexes();
+    bench_phase("secondary_indexes", elapsed_ms_precise(&start), case_count, out);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long rows = 0;
+    for (int i = 0; i < therapist_count; i++) {
+        CaseQuery q = { 0, therapist_at(i)->id, 0, CASE_ACTIVE, 0 };
+        query_cases(&q, count_slot, &rows);
     }
+    bench_phase("therapist_caseload", elapsed_ms_precise(&start), therapist_count, out);
     
-    int choice;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ensure_review_queues();
+    for (int i = 0; i < supervisor_count; i++) rows += review_pending(supervisor_at(i)->id);
+    bench_phase("review_queues", elapsed_ms_precise(&start), supervisor_count, out);
     
-    while(1) {
-        print_menu_header("Supervisor Dashboard");
-        printf("Welcome, %s\n\n", s->name);
-        
-        printf("1. View Cases Under Supervision\n");
-        printf("2. Review Therapy Plans\n");
-        printf("3. Evaluate Cases\n");
-        printf("4. Generate Reports\n");
-        printf("5. Return to Main Menu\n");
-        printf("Choice: ");
-        scanf("%d", &choice);
-        
-        switch(choice) {
-            case 1: {
-                printf("\nCases Under Your Supervision:\n");
-                printf("ID\tPatient\tTherapist\tSessions\tStatus\n");
-                printf("-----------------------------------------------\n");
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].supervisor_id == supervisor_id) {
-                        char patient_name[50] = "Unknown";
-                        for (int j = 0; j < patient_count; j++) {
-                            if (patients[j].id == cases[i].patient_id) {
-                                strncpy(patient_name, patients[j].name, sizeof(patient_name));
-                                break;
-                            }
-                        }
-                        
-                        char therapist_name[50] = "Unknown";
-                        for (int j = 0; j < therapist_count; j++) {
-                            if (therapists[j].id == cases[i].therapist_id) {
-                                strncpy(therapist_name, therapists[j].name, sizeof(therapist_name));
-                                break;
-                            }
-                        }
-                        
-                        printf("%d\t%.15s\t%.15s\t%d\t\t%s\n", 
-                              cases[i].id, patient_name, therapist_name,
-                              cases[i].session_count, cases[i].status);
-                    }
-                }
-                break;
-            }
-            case 2: {
-                printf("\nCases Needing Plan Review:\n");
-                bool found = false;
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].supervisor_id == supervisor_id && 
-                        cases[i].session_count == 0) {
-                        printf("Case ID: %d | Patient ID: %d\n", 
-                              cases[i].id, cases[i].patient_id);
-                        found = true;
-                    }
-                }
-                if (!found) printf("No cases need plan review at this time.\n");
-                
-                printf("\nEnter Case ID to review plan (or 0 to cancel): ");
-                int case_id;
-                scanf("%d", &case_id);
-                if (case_id == 0) break;
-                
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].supervisor_id == supervisor_id) {
-                        view_case_details(i);
-                        printf("\n1. Approve Plan\n2. Request Changes\nChoice: ");
-                        int review_choice;
-                        scanf("%d", &review_choice);
-                        if (review_choice == 1) {
-                            printf("Plan approved. Therapist can now begin sessions.\n");
-                        } else {
-                            printf("Enter feedback for changes: ");
-                            clear_input_buffer();
-                            char feedback[500];
-                            fgets(feedback, sizeof(feedback), stdin);
-                            feedback[strcspn(feedback, "\n")] = '\0';
-                            printf("Feedback sent to therapist.\n");
-                        }
-                        break;
-                    }
-                }
-                break;
-            }
-            case 3: {
-                printf("\nCases Ready for Evaluation (10+ sessions):\n");
-                bool found = false;
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].supervisor_id == supervisor_id && 
-                        cases[i].session_count >= 10 && 
-                        cases[i].is_active) {
-                        printf("Case ID: %d | Sessions: %d\n", 
-                              cases[i].id, cases[i].session_count);
-                        found = true;
-                    }
-                }
-                if (!found) printf("No cases ready for evaluation at this time.\n");
-                
-                printf("\nEnter Case ID to evaluate (or 0 to cancel): ");
-                int case_id;
-                scanf("%d", &case_id);
-                if (case_id == 0) break;
-                
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].supervisor_id == supervisor_id) {
-                        evaluate_case(i);
-                        break;
-                    }
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    print_analytics(0);
+    fflush(stdout);
+    double analytics_ms = elapsed_ms_precise(&start);
+    dup2(saved, STDOUT_FILENO);
+    close(null_fd);
+    close(saved);
+    bench_phase("analytics", analytics_ms, case_count, out);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ensure_date_index();
+    long entries = 0;
+    Date today = date_today();
+    for (int week = 0; week < 52; week++) {
+        sessions_in_range(today - 7 * (week + 1), today - 7 * week - 1, count_entry, &entries);
+    }
+    bench_phase("sessions_by_week", elapsed_ms_precise(&start), 52, out);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ensure_text_index();
+    bench_phase("text_index", elapsed_ms_precise(&start), case_count, out);
+    
+    static const char *queries[] = {
+        "fluency", "swallow strategy", "\"chin tuck\"", "artic*", "word finding",
+        "breath support voice", "\"minimal pairs\"", "independent*", "aphasia", "parent training"
+    };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long hits = 0;
+    for (int i = 0; i < 100; i++) text_search(queries[i % 10], count_hit, &hits);
+    bench_phase("search", elapsed_ms_precise(&start), 100, out);
+    
+    int reports = case_count < 10000 ? case_count : 10000;
+    ReportWriter w = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < reports; i++) {
+        w.len = 0;
+        write_progress_report(&w, (int)((long)i * case_count / reports));
+    }
+    bench_phase("progress_report", elapsed_ms_precise(&start), reports, out);
+    report_free(&w);
+}
+
+// Runs each size in two child processes inside a scratch directory: one
+// generates the clinic and saves it, the next loads it and times the
+// read paths. Results go to stdout and, as JSON lines, to json_path.
+int run_bench(ClinicConfig *cfg, const char *sizes, const char *json_path) {
+    FILE *json = NULL;
+    if (json_path != NULL && (json = fopen(json_path, "a")) == NULL) {
+        fprintf(stderr, "Cannot open %s\n", json_path);
+        return 1;
+    }
+    char dir[] = "therapy_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        fprintf(stderr, "Cannot create a scratch directory.\n");
+        return 1;
+    }
+    printf("%9s  %-20s %13s %14s %16s\n", "cases", "phase", "time", "count", "rate");
+    
+    int failures = 0;
+    char *list = strdup(sizes);
+    for (char *save = NULL, *item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        BenchOutput out = { json, atoi(item) };
+        if (out.cases <= 0) continue;
+        for (int step = 0; step < 2; step++) {
+            fflush(stdout);
+            if (json != NULL) fflush(json);
+            pid_t pid = fork();
+            if (pid == 0) {
+                if (step == 0) {
+                    ClinicConfig run = *cfg;
+                    run.cases = out.cases;
+                    generate_clinic(&run, bench_phase, &out);
+                    struct timespec start;
+                    clock_gettime(CLOCK_MONOTONIC, &start);
+                    save_data();
+                    bench_phase("save_data", elapsed_ms_precise(&start), case_count, &out);
+                } else {
+                    bench_queries(&out);
                 }
-                break;
+                fflush(stdout);
+                _exit(0);
             }
-            case 4: {
-                printf("\nEnter Case ID to generate report: ");
-                int case_id;
-                scanf("%d", &case_id);
-                for (int i = 0; i < case_count; i++) {
-                    if (cases[i].id == case_id && cases[i].supervisor_id == supervisor_id) {
-                        generate_progress_report(i, true);
-                        break;
-                    }
-                }
+            int status = 0;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "Benchmark step failed for %d cases.\n", out.cases);
+                failures++;
                 break;
             }
-            case 5:
-                return;
-            default:
-                printf("Invalid choice.\n");
         }
+        remove(FILENAME);
+    }
+    free(list);
+    if (chdir("..") != 0 || rmdir(dir) != 0) fprintf(stderr, "Could not remove %s\n", dir);
+    if (json != NULL) fclose(json);
+    return failures > 0 ? 1 : 0;
+}
+
+#ifndef NO_METRICS
+static const char *op_names[OP_COUNT] = {
+    "load_data", "save_data", "wal_recover", "wal_sync", "checkpoint", "apply_mutation",
+    "query_cases", "text_search", "sessions_in_range", "progress_report", "export_reports",
+    "analytics", "search_menu", "therapist_menu", "supervisor_menu", "server_read", "server_write"
+};
+
+static const char *counter_names[MC_COUNT] = {
+    "data_bytes_loaded", "data_bytes_saved", "wal_bytes_written", "report_bytes_written",
+    "id_index_hits", "id_index_misses", "posting_hits", "posting_misses",
+    "text_term_hits", "text_term_misses"
+};
+
+// Upper bound of a histogram bucket, in nanoseconds.
+static uint64_t metrics_bucket_value(int b) {
+    if (b < (1 << METRIC_SUB_BITS)) return b;
+    int group = b >> METRIC_SUB_BITS;
+    uint64_t low = (uint64_t)((1 << METRIC_SUB_BITS) + (b & ((1 << METRIC_SUB_BITS) - 1))) << (group - 1);
+    return low + ((uint64_t)1 << (group - 1)) - 1;
+}
+
+static uint64_t metrics_percentile(const OpMetrics *m, uint64_t count, double p) {
+    uint64_t rank = (uint64_t)ceil(count * p), seen = 0;
+    if (rank == 0) rank = 1;
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+        seen += atomic_load_explicit(&m->buckets[b], memory_order_relaxed);
+        if (seen >= rank) return metrics_bucket_value(b);
+    }
+    return atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+}
+#endif
+
+// Formats every operation that ran at least once, then the counters,
+// either as a table or as one JSON object.
+void metrics_write(ReportWriter *w, bool json) {
+#ifdef NO_METRICS
+    report_printf(w, json ? "{\"metrics\": \"compiled out\"}\n" : "Metrics are compiled out (NO_METRICS).\n");
+#else
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char *quantile_names[] = { "p50", "p90", "p99", "p999" };
+    if (json) {
+        report_printf(w, "{\"operations\": {");
+    } else {
+        report_printf(w, "%-18s %9s %11s %10s %10s %10s %10s %10s %10s\n", "operation", "count", "total ms",
+                      "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    }
+    bool first = true;
+    for (int op = 0; op < OP_COUNT; op++) {
+        const OpMetrics *m = &op_metrics[op];
+        uint64_t count = atomic_load_explicit(&m->count, memory_order_relaxed);
+        if (count == 0) continue;
+        uint64_t total = atomic_load_explicit(&m->total_ns, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&m->max_ns, memory_order_relaxed);
+        uint64_t q[4];
+        for (int i = 0; i < 4; i++) {
+            q[i] = metrics_percentile(m, count, quantiles[i]);
+            if (q[i] > max) q[i] = max;
+        }
+        
+        if (json) {
+            report_printf(w, "%s\n  \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"max_ns\": %llu", first ? "" : ",",
+                          op_names[op], (unsigned long long)count, (unsigned long long)total, (unsigned long long)max);
+            for (int i = 0; i < 4; i++) report_printf(w, ", \"%s_ns\": %llu", quantile_names[i], (unsigned long long)q[i]);
+            report_printf(w, "}");
+        } else {
+            report_printf(w, "%-18s %9llu %11.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", op_names[op],
+                          (unsigned long long)count, total / 1e6, total / 1e3 / count,
+                          q[0] / 1e3, q[1] / 1e3, q[2] / 1e3, q[3] / 1e3, max / 1e3);
+        }
+        first = false;
     }
-}
\ No newline at end of file
+    report_printf(w, json ? "},\n \"counters\": {" : "\n");
+    for (int i = 0; i < MC_COUNT; i++) {
+        unsigned long long value = atomic_load_explicit(&metric_counters[i], memory_order_relaxed);
+        if (json) report_printf(w, "%s\"%s\": %llu", i ? ", " : "", counter_names[i], value);
+        else report_printf(w, "%-22s %llu\n", counter_names[i], value);
+    }
+    if (json) report_printf(w, "}}\n");
+#endif
+}
+
+void metrics_dump_at_exit() {
+    ReportWriter w = { .sinks = { stderr }, .sink_count = 1 };
+    metrics_write(&w, metrics_at_exit_json);
+    report_flush(&w);
+    report_free(&w);
+}